@@ -0,0 +1,92 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+    Bump allocator that owns the objects of a scene: primitives, bvh nodes, materials and
+    textures. Objects are placed one after another in large blocks and never move. The arena
+    destroys them in reverse order of construction when it goes away itself. The handles it
+    hands out are shared_ptrs that own nothing (no control block), so copying one is a plain
+    pointer copy and objects can refer to each other without keeping anything alive; they stay
+    valid as long as the arena does. Not thread safe, scenes are built on one thread
+*/
+class scene_arena {
+    public:
+        static constexpr size_t block_size = size_t(1) << 16;
+
+        scene_arena() {}
+
+        scene_arena(const scene_arena &) = delete;
+        scene_arena &operator=(const scene_arena &) = delete;
+
+        ~scene_arena() {
+            for (auto it = dtors.rbegin(); it != dtors.rend(); ++it) {
+                it->second(it->first);
+            }
+        }
+
+        template <typename T, typename... Args>
+        std::shared_ptr<T> make(Args&&... args) {
+            void *mem = allocate(sizeof(T), alignof(T));
+            T *obj = new (mem) T(std::forward<Args>(args)...);
+
+            if constexpr (!std::is_trivially_destructible_v<T>) {
+                dtors.emplace_back(obj, [](void *p) { static_cast<T*>(p)->~T(); });
+            }
+
+            // aliases an empty owner: not null, but never counted or deleted
+            return std::shared_ptr<T>(std::shared_ptr<void>(), obj);
+        }
+
+        // bytes handed out so far
+        size_t used() const { return bytes; }
+
+    private:
+        std::vector<std::unique_ptr<std::byte[]>> blocks;
+        std::vector<std::pair<void*, void (*)(void*)>> dtors;   // of the objects that need one, in order built
+
+        std::byte *cur = nullptr;       // free space of the current block
+        size_t left = 0;
+        size_t bytes = 0;
+
+        void *allocate(size_t size, size_t align) {
+            size_t pad = cur ? (align - reinterpret_cast<uintptr_t>(cur) % align) % align : 0;
+
+            if (!cur || pad + size > left) {
+                // objects too big to share a block get one of their own
+                size_t cap = std::max(block_size, size + align);
+                blocks.emplace_back(new std::byte[cap]);
+                cur = blocks.back().get();
+                left = cap;
+                pad = (align - reinterpret_cast<uintptr_t>(cur) % align) % align;
+            }
+
+            void *p = cur + pad;
+            cur += pad + size;
+            left -= pad + size;
+            bytes += size;
+            return p;
+        }
+};
+
+// Arena the scene of this process is built in, its objects live until exit
+inline scene_arena &scene_memory() {
+    static scene_arena arena;
+    return arena;
+}
+
+// an object of the scene, placed in scene_memory()
+template <typename T, typename... Args>
+std::shared_ptr<T> scene_make(Args&&... args) {
+    return scene_memory().make<T>(std::forward<Args>(args)...);
+}
+
+#endif
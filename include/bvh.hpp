@@ -2,6 +2,7 @@
 #define BVH_HPP
 
 #include <algorithm>
+#include <bitset>
 
 #include "axis-bounding-box.hpp"
 #include "hittable.hpp"
@@ -38,8 +39,8 @@ class bvh_node : public hittable {
                 std::sort(std::begin(objs) + start, std::begin(objs) + end, comparator);
 
                 auto middle = start + obj_span / 2;
-                left = make_shared<bvh_node>(objs, start, middle);
-                right = make_shared<bvh_node>(objs, middle, end);
+                left = scene_make<bvh_node>(objs, start, middle);
+                right = scene_make<bvh_node>(objs, middle, end);
             }
 
             bound_box = axis_bound_box(left->bounding_box(), right->bounding_box());
@@ -56,6 +57,37 @@ class bvh_node : public hittable {
             return hit_l || hit_r;
         }
 
+        /*
+            Packet traversal. A coherent packet that misses the box as a whole skips it with one
+            test; otherwise the box is tested against the rays in SIMD lanes and the rays inside
+            go down together until too few are left to share the work, which then finish on
+            their own
+        */
+        void hit_packet(ray_packet &pk, uint32_t mask, uint32_t &hits) const override {
+            if (pk.misses(bound_box, mask)) {
+                return;
+            }
+
+            uint32_t inside = pk.hits_box(bound_box, mask);
+            if (inside == 0) {
+                return;
+            }
+
+            int count = int(std::bitset<ray_packet::max_size>(inside).count());
+
+            if (count == 1 || count * 4 < pk.size) {
+                for (int k = 0; k < pk.size; k++) {
+                    if (inside >> k & 1) {
+                        hit_one(pk, k, hits);
+                    }
+                }
+                return;
+            }
+
+            left->hit_packet(pk, inside, hits);
+            right->hit_packet(pk, inside, hits);
+        }
+
         axis_bound_box bounding_box() const override { return bound_box; } 
 
         static const axis_bound_box empty, universe;
@@ -4,12 +4,48 @@
 #include <sstream>
 #include <fstream>
 #include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <condition_variable>
+#include <mutex>
 
 #include "pdf.hpp"
 #include "constants.hpp"
 #include "hittable.hpp"
 #include "materials.hpp"
+#include "environment.hpp"
 #include "thread_pools.hpp"
+#include "framebuffer.hpp"
+#include "image_io.hpp"
+#include "distributed.hpp"
+#include "wavefront.hpp"
+
+/*
+    Integrators a render kernel is built on. mis_integrator takes a shadow ray toward the lights
+    at every non-specular vertex and weighs it against the bsdf sample with the power heuristic;
+    bsdf_integrator only follows bsdf samples, for scenes without lights to sample
+*/
+struct mis_integrator {
+    static constexpr bool samples_lights = true;
+};
+
+struct bsdf_integrator {
+    static constexpr bool samples_lights = false;
+};
+
+/*
+    What a render kernel is compiled for: its integrator, and whether the camera has a defocus
+    blur and the background a texture. The camera picks the kernel once per frame, so the per
+    sample code carries no branches for features the render does not use
+*/
+template <typename Integrator, bool Defocus, bool TexturedBg>
+struct render_kernel {
+    using integrator = Integrator;
+    static constexpr bool defocus = Defocus;
+    static constexpr bool textured_bg = TexturedBg;
+};
 
 class camera {
     public:
@@ -26,54 +62,45 @@ class camera {
         vec3 lk_at = vec3(0, 0, -1);
         vec3 vup = vec3(0, 1, 0);
 
+        int rr_depth = default_rr_depth;    // bounces before russian roulette may end a path
+
         double defocus_angle = 0;  // variation angle of rays through each pixel
         double focus_dist    = 10; // distance from cam to lookfrom point to plane of perfect focus
 
         double gamma = 1.0;
         bool is_hdr = false;
 
-        /*
-            Render row function including importance sampling. Rounded pixels :)
-        */
-        void render_row(int j, const hittable &world, const hittable &lights, std::string** row_output) {
-
-            for (int i = 0; i < img_wd; i++) {
-                color pix_col(0, 0, 0);
-                for (int k = -sqrt_spp; k <= sqrt_spp; ++k) {
-                    for (int s = -sqrt_spp; s <= sqrt_spp; ++s) {
-                        if (k * k + s * s <= sqrt_spp * sqrt_spp) {
-                            ray r = get_ray(i, j, k, s);
-                            pix_col += ray_color(r, max_depth, world, lights);
-                        }
-                    }
-                }
+        bool sample_env = true;     // importance sample hdr backgrounds as a light
 
-                color out_col = pix_col * anti_alias_scale;
-                row_output[j][i] = write_color(out_col, anti_alias, is_hdr, gamma);
-            }
-        }
+        uint64_t seed = 0;          // the same seed renders the same image on any number of threads
+        sampler_type sampler = sampler_type::SOBOL;
 
-        /*
-            Render row function not intended for importance sampling. Rounded pixels :)
-        */
-        void render_row(int j, const hittable &world, std::string** row_output) {
-
-            for (int i = 0; i < img_wd; i++) {
-                color pix_col(0, 0, 0);
-                for (int k = -sqrt_spp; k <= sqrt_spp; k++) {
-                    for (int l = -sqrt_spp; l <= sqrt_spp; l++) {
-                        if (k * k + l * l <= sqrt_spp * sqrt_spp) {
-                            ray r = get_ray(i, j, k, l);
-                            pix_col += ray_color(r, max_depth, world);
-                        }
-                    }
-                }
+        bool adaptive = false;                          // spend samples where the image is noisy
+        double adaptive_threshold = default_adaptive_threshold; // relative error a pixel stops at
+        int adaptive_min_spp = 16;                      // samples every pixel takes first
+        int adaptive_max_scale = 4;                     // a pixel takes at most this many times the base spp
 
-                color out_col = pix_col * anti_alias_scale;
+        bool progressive = false;   // write the image after every pass
+        int pass_spp = 16;          // samples per pixel per progressive pass
+        double time_budget = 0;     // seconds a progressive render may take, 0 for no limit
 
-                row_output[j][i] = write_color(out_col, anti_alias, is_hdr, gamma);
-            }
-        }
+        int tile_size = default_tile_size;  // side of the square tiles threads take work in
+
+        bool wavefront = false;     // trace tiles stage by stage over batches of paths instead of path by path
+        int wavefront_batch = 4096; // paths in flight per tile
+        int packet_size = 16;       // wavefront: trace camera and shadow rays in packets of this many (up to 16), 0 for one by one
+
+        std::string out_path = "img.ppm";               // where the image is written
+        image_format out_format = image_format::AUTO;   // AUTO goes by out_path's extension
+        bool stream = false;    // write finished bands of a single pass render as they complete
+
+        std::string checkpoint_path = "";   // where render state is saved between passes, empty for never
+        double checkpoint_interval = 60;    // seconds between checkpoints
+        bool resume = false;                // continue from checkpoint_path when it matches this render
+
+        std::string serve_addr = "";    // hand tiles to worker processes on this address instead of rendering them here
+        std::string connect_addr = "";  // render tiles for the coordinator on this address
+        int scene_id = -1;              // lets a coordinator check its workers built the same scene
 
         /*
             Rendering function for when importance sampling is occuring
@@ -82,30 +109,10 @@ class camera {
 
             init();
 
-            ThreadPool pool(thread::hardware_concurrency());
-            
-            std::ofstream file("img.ppm");
-            file << "P3\n" << img_wd << " " << img_ht << "\n255\n";
-
-            std::string** output = new std::string*[img_ht];
-            for (int i = 0; i < img_ht; i++) {
-                output[i] = new std::string[img_wd];
-            }
-
-            for (int j = 0; j < img_ht; j++) {
-                int row = j;
-                pool.enqueue(([this, &world, &lights, output, row]() {
-                    render_row(row, world, lights, output);
-                }));
-            }
-
-            pool.wait_till_done();
+            // split light samples between the hdr background and the scene lights
+            env_prob = !env ? 0.0 : lights.power() > 0 ? 0.5 : 1.0;
 
-            for (int i = 0; i < img_ht; i++) {
-                for (int j = 0; j < img_wd; j++) {
-                    file << output[i][j];
-                }
-            }
+            render_image(world, &lights);
         }
 
         /*
@@ -115,109 +122,134 @@ class camera {
 
             init();
 
-            ThreadPool pool(thread::hardware_concurrency());
-
-            std::ofstream file("img.ppm");
-            file << "P3\n" << img_wd << " " << img_ht << "\n255\n";
-
-            std::string** output = new std::string*[img_ht];
-            for (int i = 0; i < img_ht; i++) {
-                output[i] = new std::string[img_wd];
-            }
-
-            for (int j = 0; j < img_ht; j++) {
-                int row = j;
-                pool.enqueue(([this, &world, output, row]() {
-                    render_row(row, world, output);
-                }));
-            }
-
-            pool.wait_till_done();
-
-            for (int i = 0; i < img_ht; i++) {
-                for (int j = 0; j < img_wd; j++) {
-                    file << output[i][j];
-                }
+            if (env) {
+                // an hdr background is a light, render through the light sampled path
+                render(world, hittable_list());
+                return;
             }
 
+            render_image(world, nullptr);
         }
 
+        // accumulated radiance and sample counts of the last render
+        const framebuffer &image() const { return film; }
+
         /*
-            Gets ray color while using importance sampling
+            Gets ray color. Iterative path loop carrying the path throughput, with russian
+            roulette once the path is past rr_depth bounces. Under mis_integrator every
+            non-specular vertex takes a shadow ray toward the lights (next event estimation) and a
+            bsdf sample, both weighted with the power heuristic; lights is unused otherwise
         */
-        color ray_color(const ray &r, int depth, const hittable &world, const hittable &lights) {
-            if (depth <= 0) { return color(0, 0, 0); }
+        template <typename Kernel>
+        color ray_color(const ray &r, int depth, const hittable &world, const hittable *lights) {
+            constexpr bool nee = Kernel::integrator::samples_lights;
+
+            color radiance(0, 0, 0);
+            color throughput(1, 1, 1);
+            ray cur = r;
+
+            double bsdf_pdf = 0;    // pdf of the bsdf sample that made cur, 0 for camera and specular rays
+            vec3 prev_p;
+
+            for (int bounce = 0; bounce < depth; bounce++) {
+                hit_record hrec;
+
+                sample_dim(bounce, sample_dims::hit);
+                if (!world.hit(cur, interval(0.001, inf), hrec)) {
+                    color bg_col = background<Kernel::textured_bg>(cur);
+                    if constexpr (nee) {
+                        if (bsdf_pdf > 0 && env_prob > 0) {
+                            bg_col *= power_heuristic(bsdf_pdf, light_pdf(prev_p, cur.direction(), *lights));
+                        }
+                    }
+                    radiance += throughput * bg_col;
+                    break;
+                }
+                surface_record rec = hrec.finalize(cur);
 
-            hit_record rec;
+                if constexpr (nee) {
+                    color emission = material_of(rec.mat).emitted(cur, rec, rec.u, rec.v, rec.p);
+                    if (bsdf_pdf > 0 && emission.len_sqrd() > 0) {
+                        // the previous vertex could also have reached this emitter through its shadow ray
+                        emission *= power_heuristic(bsdf_pdf, light_pdf(prev_p, cur.direction(), *lights));
+                    }
+                    radiance += throughput * emission;
 
-            if (!world.hit(r, interval(0.001, inf), rec)) {
-                return bg;
-            }
+                    scatter_record srec;
+                    sample_dim(bounce, sample_dims::bsdf);
+                    if (!material_of(rec.mat).scatter(cur, rec, srec)) {
+                        break;
+                    }
 
-            scatter_record srec;
-            
-            color col_from_emission = rec.mat->emitted(r, rec, rec.u, rec.v, rec.p);
+                    if (srec.skip_pdf) {
+                        throughput = throughput * srec.atten;
+                        cur = srec.skip_pdf_ray;
+                        bsdf_pdf = 0;
+                    } else {
+                        const pdf &mat_pdf = *srec.pdf_ptr();
+
+                        sample_dim(bounce, sample_dims::light);
+                        radiance += throughput * sample_light<Kernel::textured_bg>(cur, rec, srec, mat_pdf, world, *lights);
+
+                        sample_dim(bounce, sample_dims::bsdf);
+                        ray scattered = ray(rec.p, mat_pdf.generate(), cur.time());
+                        bsdf_pdf = mat_pdf.value(scattered.direction());
+                        if (bsdf_pdf <= 0) {
+                            break;
+                        }
 
-            if (!rec.mat->scatter(r, rec, srec)) {
-                return col_from_emission;
-            }
+                        double scattering_pdf = material_of(rec.mat).scattering_pdf(cur, rec, scattered);
 
-            if (srec.skip_pdf) {
-                return srec.atten * ray_color(srec.skip_pdf_ray, depth-1, world, lights);
-            }
-
-            auto lht_ptr = make_shared<hittable_pdf>(lights, rec.p);
-            mix_pdf p(lht_ptr, srec.pdf_ptr);
+                        throughput = throughput * srec.atten * scattering_pdf / bsdf_pdf;
+                        prev_p = rec.p;
+                        cur = scattered;
+                    }
+                } else {
+                    ray scattered;
+                    color atten;
+                    radiance += throughput * material_of(rec.mat).emitted(rec.u, rec.v, rec.p);
 
-            ray scattered = ray(rec.p, p.generate(), r.time());
-            auto pdf_val = p.value(scattered.direction());
+                    sample_dim(bounce, sample_dims::bsdf);
+                    if (!material_of(rec.mat).scatter(cur, rec, atten, scattered)) {
+                        break;
+                    }
 
-            double scattering_pdf = rec.mat->scattering_pdf(r, rec, scattered);
+                    throughput = throughput * atten;
+                    cur = scattered;
+                }
 
-            color sample_col = ray_color(scattered, depth-1, world, lights);
-            color col_from_scatter = (srec.atten * scattering_pdf * sample_col) / pdf_val;
+                if (!survives_roulette(bounce, throughput)) {
+                    break;
+                }
+            }
 
-            return col_from_emission + col_from_scatter;
+            return radiance;
         }
 
-        /*
-            Gets ray color when there is NOT importance sampling
-        */
-        color ray_color(const ray &r, int depth, const hittable &world) {
-            if (depth <= 0) { return color(0, 0, 0); }
-
-            hit_record rec;
-
-            if (!world.hit(r, interval(0.001, inf), rec)) {
-                if (bg_tex) {
-                    auto unit_dir = unit_vector(r.direction());
-                    double u, v; get_spherical_uv(unit_dir, u, v);
-                    return bg_tex->value(u, v, unit_dir);
-                } else {
-                    return bg;
-                }
-            }
+    private:
+        static constexpr char checkpoint_magic[8] = {'R', 'T', 'C', 'K', 'P', 'T', '0', '1'};
 
-            ray scattered;
-            color atten;
-            color col_from_emission = rec.mat->emitted(rec.u, rec.v, rec.p);
+        framebuffer film;       // accumulated samples of the last render
+        stage_times wave_times; // where wavefront renders spend their time
+        image_writer writer;    // encodes and writes images off the render thread
 
-            if (!rec.mat->scatter(r, rec, atten, scattered)) {
-                return col_from_emission;
-            }
+        // pixels [x0, x1) x [y0, y1)
+        struct tile {
+            int x0, y0, x1, y1;
+        };
 
-            color col_from_scatter = atten * ray_color(scattered, depth - 1, world);
+        // traces samples [from, to) of every pixel of a tile into sums, path by path
+        using tile_kernel = void (camera::*)(const tile &, const std::vector<int> &, const std::vector<int> &, int,
+                                             const hittable &, const hittable *, std::vector<sample_sum> &);
 
-            return col_from_emission + col_from_scatter;
-        }
+        tile_kernel kernel = nullptr;   // picked for the frame by select_kernel
 
-    private:
         double anti_alias_scale;
 
         int sqrt_spp;           // square root of number of samples per pixel
         double recip_sqrt_spp;  // 1 / sqrt_spp
 
-        int progress = 0;
+        std::vector<std::pair<int, int>> strata;    // sub-pixel cells inside the rounded pixel
 
         vec3 center, cam_center, pix_loc;
         vec3 pix_delt_u, pix_delt_v;
@@ -226,7 +258,22 @@ class camera {
 
         vec3 defocus_u, defocus_v;
 
+        shared_ptr<env_light> env;                  // sampler for an hdr bg_tex
+        shared_ptr<texture> env_src = nullptr;      // bg_tex env was built from
+        double env_prob = 0;                        // chance a light sample goes to env
+
         void init() {
+
+            if (!sample_env || !bg_tex) {
+                env = nullptr;
+            } else if (bg_tex != env_src) {
+                auto hdr = std::dynamic_pointer_cast<image_hdr_tex>(bg_tex);
+                env = hdr ? make_shared<env_light>(hdr) : nullptr;
+                if (env && !env->valid()) {
+                    env = nullptr;
+                }
+            }
+            env_src = env ? bg_tex : nullptr;
             
             img_ht = int(img_wd / aspect) < 1 ? 1 : int(img_wd / aspect);
 
@@ -234,6 +281,15 @@ class camera {
             anti_alias_scale = 1.0 / (sqrt_spp * sqrt_spp);
             recip_sqrt_spp = 1.0 / sqrt_spp;
 
+            strata.clear();
+            for (int k = -sqrt_spp; k <= sqrt_spp; k++) {
+                for (int l = -sqrt_spp; l <= sqrt_spp; l++) {
+                    if (k * k + l * l <= sqrt_spp * sqrt_spp) {
+                        strata.emplace_back(k, l);
+                    }
+                }
+            }
+
             center = lk_from;
 
             // viewport dims
@@ -269,49 +325,1160 @@ class camera {
         /*
             Get ray for rounded pixels (sphere anti-aliasing)
         */
+        template <bool Defocus>
         ray get_ray(int i, int j, int s_i, int s_j) const {
+            auto &stream = thread_sampler();
+
+            stream.set_dimension(sample_dims::pixel);
             auto offset = sample_sqr_stratified(s_i, s_j);
             auto pix_sample = pix_loc
                         + ((i + offset.x()) * pix_delt_u)
                         + ((j + offset.y()) * pix_delt_v);
-            auto ray_orig = (defocus_angle <= 0) ? center : defocus_disk_sample();
+
+            stream.set_dimension(sample_dims::lens);
+            auto ray_orig = Defocus ? defocus_disk_sample() : center;
             auto ray_dir = pix_sample - ray_orig;
 
+            stream.set_dimension(sample_dims::time);
             auto r_time = random_double();
 
             return ray(ray_orig, ray_dir, r_time);
         }
 
+        vec3 sample_sqr_stratified(int s_i, int s_j) const {
+            auto px = ((s_i + rand_double()) * recip_sqrt_spp) - 0.5;
+            auto py = ((s_j + rand_double()) * recip_sqrt_spp) - 0.5;
+
+            return vec3(px, py, 0);
+        }
+
         /*
-            Get ray for square anti-aliasing
+            Radiance arriving along a ray that left the scene
         */
-        ray get_ray(int i, int j) const {
-            auto offset = sample_sqr();
-            auto pix_sample = pix_loc
-                        + ((i + offset.x()) * pix_delt_u)
-                        + ((j + offset.y()) * pix_delt_v);
-            auto ray_orig = (defocus_angle <= 0) ? center : defocus_disk_sample();
-            auto ray_dir = pix_sample - ray_orig;
+        color background(const ray &r) const {
+            return bg_tex ? background<true>(r) : background<false>(r);
+        }
 
-            auto r_time = random_double();
+        template <bool TexturedBg>
+        color background(const ray &r) const {
+            if constexpr (!TexturedBg) {
+                return bg;
+            }
 
-            return ray(ray_orig, ray_dir, r_time);
+            auto unit_dir = unit_vector(r.direction());
+            double u, v; get_spherical_uv(unit_dir, u, v);
+            return bg_tex->value(u, v, unit_dir);
         }
 
-        vec3 sample_sqr_stratified(int s_i, int s_j) const {
-            auto px = ((s_i + rand_double()) * recip_sqrt_spp) - 0.5;
-            auto py = ((s_j + rand_double()) * recip_sqrt_spp) - 0.5;
+        /*
+            Density of picking dir from p as a light sample, over both the hdr background and the
+            scene lights
+        */
+        double light_pdf(const vec3 &p, const vec3 &dir, const hittable &lights) const {
+            // a light sample that failed
+            if (dir.len_sqrd() <= 0) {
+                return 0;
+            }
 
-            return vec3(px, py, 0);
+            double pdf = 0;
+            if (env_prob > 0) pdf += env_prob * env->pdf_value(dir);
+            if (env_prob < 1) pdf += (1 - env_prob) * lights.pdf_value(p, dir);
+            return pdf;
+        }
+
+        /*
+            Next event estimation. Picks a direction toward the lights, traces a shadow ray along it and
+            returns the light found there, weighted against the material's own pdf
+        */
+        template <bool TexturedBg>
+        color sample_light(const ray &r, const surface_record &rec, const scatter_record &srec,
+                           const pdf &mat_pdf, const hittable &world, const hittable &lights) const {
+            vec3 dir = light_direction(rec.p, lights);
+            ray shadow(rec.p, dir, r.time());
+
+            double l_pdf = light_pdf(rec.p, dir, lights);
+            if (l_pdf <= 0) {
+                return color(0, 0, 0);
+            }
+
+            return light_contribution(r, rec, srec, mat_pdf, shadow, l_pdf, incoming_light<TexturedBg>(shadow, world));
+        }
+
+        // direction from p toward a light, either the hdr background or a scene light
+        vec3 light_direction(const vec3 &p, const hittable &lights) const {
+            return (env_prob > 0 && random_double() < env_prob) ? env->random() : lights.random(p);
+        }
+
+        // light arriving along a shadow ray, from what it hits first or from the background
+        template <bool TexturedBg>
+        color incoming_light(const ray &shadow, const hittable &world) const {
+            hit_record lrec;
+            if (world.hit(shadow, interval(0.001, inf), lrec)) {
+                surface_record light = lrec.finalize(shadow);
+                return material_of(light.mat).emitted(shadow, light, light.u, light.v, light.p);
+            }
+            return background<TexturedBg>(shadow);
         }
 
-        vec3 sample_sqr() const {
-            return vec3(rand_double() - 0.5, rand_double() - 0.5, 0);
+        // next event estimate of light arriving along shadow, weighted against the material's pdf
+        color light_contribution(const ray &r, const surface_record &rec, const scatter_record &srec, const pdf &mat_pdf,
+                                 const ray &shadow, double l_pdf, const color &incoming) const {
+            if (incoming.len_sqrd() <= 0) {
+                return color(0, 0, 0);
+            }
+
+            double scattering_pdf = material_of(rec.mat).scattering_pdf(r, rec, shadow);
+            double weight = power_heuristic(l_pdf, mat_pdf.value(shadow.direction()));
+
+            return srec.atten * scattering_pdf * incoming * weight / l_pdf;
+        }
+
+        /*
+            Russian roulette. Past rr_depth bounces a path is continued with probability equal to
+            its largest throughput channel, and re-weighted so the estimate stays unbiased
+        */
+        bool survives_roulette(int bounce, color &throughput) const {
+            if (bounce + 1 < rr_depth) {
+                return true;
+            }
+
+            sample_dim(bounce, sample_dims::roulette);
+
+            double p = std::fmin(std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z())), 0.95);
+            if (p <= 0 || random_double() >= p) {
+                return false;
+            }
+
+            throughput /= p;
+            return true;
         }
 
         vec3 defocus_disk_sample() const {
-            auto p = random_in_unit_disk();
-            return center + (p[0] * defocus_u) + (p[1] * defocus_v);
+            double x, y;
+            auto u = random_double();
+            auto v = random_double();
+            concentric_disk(u, v, x, y);
+            return center + (x * defocus_u) + (y * defocus_v);
+        }
+
+        /*
+            Starts the thread's sample stream on sample n of pixel (i, j) and makes its camera ray.
+            Every run of strata.size() samples covers each stratum of the rounded pixel once, in a
+            shuffled order so the first few samples of an adaptive pixel already spread over its
+            whole footprint
+        */
+        template <bool Defocus>
+        ray camera_ray(int i, int j, int n, int spp) const {
+            thread_sampler().start(sampler, seed, i, j, n, spp);
+
+            uint32_t size = uint32_t(strata.size());
+            uint64_t pass = mix_bits(seed ^ ((uint64_t(uint32_t(j)) << 32) | uint32_t(i))) + uint64_t(n) / size;
+            const auto &cell = strata[permutation_element(uint32_t(n) % size, size, uint32_t(mix_bits(pass)))];
+            return get_ray<Defocus>(i, j, cell.first, cell.second);
+        }
+
+        ray camera_ray(int i, int j, int n, int spp) const {
+            return defocus_angle > 0 ? camera_ray<true>(i, j, n, spp) : camera_ray<false>(i, j, n, spp);
+        }
+
+        // the path by path tile kernel for this frame's integrator and features
+        void select_kernel(const hittable *lights) {
+            if (lights) {
+                kernel = select_kernel<mis_integrator>();
+            } else {
+                kernel = select_kernel<bsdf_integrator>();
+            }
+        }
+
+        template <typename Integrator>
+        tile_kernel select_kernel() const {
+            if (defocus_angle > 0) {
+                return bg_tex ? &camera::sample_paths<render_kernel<Integrator, true, true>>
+                              : &camera::sample_paths<render_kernel<Integrator, true, false>>;
+            }
+            return bg_tex ? &camera::sample_paths<render_kernel<Integrator, false, true>>
+                          : &camera::sample_paths<render_kernel<Integrator, false, false>>;
+        }
+
+        template <typename Kernel>
+        void sample_paths(const tile &t, const std::vector<int> &from, const std::vector<int> &to, int spp,
+                          const hittable &world, const hittable *lights, std::vector<sample_sum> &sums) {
+            int tile_wd = t.x1 - t.x0;
+            for (size_t q = 0; q < from.size(); q++) {
+                int i = t.x0 + int(q) % tile_wd;
+                int j = t.y0 + int(q) / tile_wd;
+                for (int n = from[q]; n < to[q]; n++) {
+                    ray r = camera_ray<Kernel::defocus>(i, j, n, spp);
+                    sums[q].add(ray_color<Kernel>(r, max_depth, world, lights));
+                }
+            }
+        }
+
+        /*
+            Samples [from, to) of every pixel of a tile, from and to in row order over the tile.
+            The sums are the same whether the tile is traced path by path or as a wavefront
+        */
+        std::vector<sample_sum> sample_tile(const tile &t, const std::vector<int> &from, const std::vector<int> &to,
+                                            int spp, const hittable &world, const hittable *lights) {
+            std::vector<sample_sum> sums(from.size());
+            if (wavefront) {
+                trace_wavefront(t, from, to, spp, world, lights, sums);
+            } else {
+                (this->*kernel)(t, from, to, spp, world, lights, sums);
+            }
+
+            return sums;
+        }
+
+        /*
+            Render tile function. Takes samples until every pixel of the tile reaches its target
+            count for this pass
+        */
+        void render_tile(const tile &t, const hittable &world, const hittable *lights,
+                         const std::vector<int> &targets, int spp) {
+            std::vector<int> from, to;
+            for (int j = t.y0; j < t.y1; j++) {
+                for (int i = t.x0; i < t.x1; i++) {
+                    size_t k = size_t(j) * img_wd + i;
+                    from.push_back(film.samples(k));
+                    to.push_back(targets[k]);
+                }
+            }
+
+            std::vector<sample_sum> sums = sample_tile(t, from, to, spp, world, lights);
+
+            size_t q = 0;
+            for (int j = t.y0; j < t.y1; j++) {
+                for (int i = t.x0; i < t.x1; i++) {
+                    film.add(size_t(j) * img_wd + i, sums[q++]);
+                }
+            }
+        }
+
+        /*
+            Wavefront tracing of a tile's samples. Paths are generated wavefront_batch at a time
+            and move through the stages together, one bounce per round: intersect, shade grouped
+            by material, then the shadow rays of the next event estimates, which also extend
+            their paths with a bsdf sample. Each stage is one loop over a queue of paths
+        */
+        void trace_wavefront(const tile &t, const std::vector<int> &from, const std::vector<int> &to, int spp,
+                             const hittable &world, const hittable *lights, std::vector<sample_sum> &sums) {
+            int tile_wd = t.x1 - t.x0;
+            size_t batch = size_t(std::max(wavefront_batch, 1));
+
+            path_queue paths;
+            paths.resize(batch);
+            std::vector<int> active, hits, shadows, next;
+
+            size_t pix = 0;
+            int n = from.empty() ? 0 : from[0];
+            sampler_scope scope;
+
+            while (pix < from.size()) {
+                auto lap = std::chrono::steady_clock::now();
+
+                // generate: camera rays for the next batch of samples, in pixel order
+                size_t count = 0;
+                active.clear();
+                while (pix < from.size() && count < batch) {
+                    if (n >= to[pix]) {
+                        if (++pix < from.size()) n = from[pix];
+                        continue;
+                    }
+
+                    size_t p = count++;
+                    scope.use(paths.stream[p]);
+                    paths.set_ray(p, camera_ray(t.x0 + int(pix) % tile_wd, t.y0 + int(pix) / tile_wd, n, spp));
+                    paths.throughput[p] = color(1, 1, 1);
+                    paths.radiance[p] = color(0, 0, 0);
+                    paths.bsdf_pdf[p] = 0;
+                    paths.pixel[p] = int(pix);
+                    active.push_back(int(p));
+                    n++;
+                }
+
+                stage_times::lap(wave_times.generate, lap);
+
+                for (int bounce = 0; bounce < max_depth && !active.empty(); bounce++) {
+                    intersect_stage(paths, active, hits, bounce, world, lights);
+                    stage_times::lap(wave_times.intersect, lap);
+
+                    group_by_material(hits, paths);
+                    stage_times::lap(wave_times.group, lap);
+
+                    next.clear();
+                    shadows.clear();
+                    shade_stage(paths, hits, shadows, next, bounce, lights);
+                    stage_times::lap(wave_times.shade, lap);
+
+                    if (lights) {
+                        shadow_stage(paths, shadows, next, bounce, world, *lights);
+                        stage_times::lap(wave_times.shadow, lap);
+                    }
+
+                    std::sort(next.begin(), next.end());
+                    active.swap(next);
+                }
+
+                for (size_t p = 0; p < count; p++) {
+                    sums[paths.pixel[p]].add(paths.radiance[p]);
+                }
+            }
+        }
+
+        /*
+            Closest hits of the active paths; paths that leave the scene take the background and
+            end. Camera rays are traced in packets when packet_size is set
+        */
+        void intersect_stage(path_queue &paths, const std::vector<int> &active, std::vector<int> &hits, int bounce,
+                             const hittable &world, const hittable *lights) {
+            sampler_scope scope;
+
+            std::vector<ray> rays;
+            std::vector<hit_record> found_recs(active.size());
+            std::vector<hit_record*> recs;
+            for (size_t q = 0; q < active.size(); q++) {
+                scope.use(paths.stream[active[q]]);
+                sample_dim(bounce, sample_dims::hit);
+                rays.push_back(paths.current(active[q]));
+                recs.push_back(&found_recs[q]);
+            }
+
+            std::vector<char> found(active.size());
+            if (bounce == 0) {
+                trace_rays(paths, active, rays, recs, found, world);
+            } else {
+                for (size_t q = 0; q < active.size(); q++) {
+                    scope.use(paths.stream[active[q]]);
+                    found[q] = world.hit(rays[q], interval(0.001, inf), *recs[q]);
+                }
+            }
+
+            hits.clear();
+            for (size_t q = 0; q < active.size(); q++) {
+                int p = active[q];
+                if (found[q]) {
+                    paths.rec[p] = found_recs[q].finalize(rays[q]);
+                    hits.push_back(p);
+                    continue;
+                }
+
+                color bg_col = background(rays[q]);
+                if (lights && paths.bsdf_pdf[p] > 0 && env_prob > 0) {
+                    bg_col *= power_heuristic(paths.bsdf_pdf[p], light_pdf(paths.prev_p[p], rays[q].direction(), *lights));
+                }
+                radiance_add(paths, p, bg_col);
+            }
+        }
+
+        /*
+            Closest hits of rays[q] for the paths of queue, packet_size rays at a time when it is
+            set. Every ray draws from its path's stream, records into recs[q] and sets found[q]
+        */
+        void trace_rays(path_queue &paths, const std::vector<int> &queue, const std::vector<ray> &rays,
+                        const std::vector<hit_record*> &recs, std::vector<char> &found, const hittable &world) const {
+            if (packet_size < 2) {
+                sampler_scope scope;
+                for (size_t q = 0; q < queue.size(); q++) {
+                    scope.use(paths.stream[queue[q]]);
+                    found[q] = world.hit(rays[q], interval(0.001, inf), *recs[q]);
+                }
+                return;
+            }
+
+            size_t size = size_t(std::min(packet_size, ray_packet::max_size));
+            ray_packet pk;
+
+            for (size_t first = 0; first < queue.size(); first += size) {
+                pk.size = int(std::min(size, queue.size() - first));
+                for (int k = 0; k < pk.size; k++) {
+                    size_t q = first + k;
+                    pk.set(k, rays[q], interval(0.001, inf), recs[q], &paths.stream[queue[q]]);
+                }
+                pk.prepare();
+
+                uint32_t got = 0;
+                world.hit_packet(pk, pk.all(), got);
+
+                for (int k = 0; k < pk.size; k++) {
+                    found[first + k] = got >> k & 1;
+                }
+            }
+        }
+
+        /*
+            Emission and scattering of every hit. Specular bounces continue straight into next;
+            diffuse ones pick a light direction and go on to the shadow stage
+        */
+        void shade_stage(path_queue &paths, const std::vector<int> &hits, std::vector<int> &shadows,
+                         std::vector<int> &next, int bounce, const hittable *lights) {
+            sampler_scope scope;
+
+            for (int p : hits) {
+                scope.use(paths.stream[p]);
+                ray cur = paths.current(p);
+                const surface_record &rec = paths.rec[p];
+
+                if (!lights) {
+                    radiance_add(paths, p, material_of(rec.mat).emitted(rec.u, rec.v, rec.p));
+
+                    ray scattered;
+                    color atten;
+                    sample_dim(bounce, sample_dims::bsdf);
+                    if (material_of(rec.mat).scatter(cur, rec, atten, scattered)) {
+                        paths.throughput[p] = paths.throughput[p] * atten;
+                        paths.set_ray(p, scattered);
+                        if (survives_roulette(bounce, paths.throughput[p])) {
+                            next.push_back(p);
+                        }
+                    }
+                    continue;
+                }
+
+                color emission = material_of(rec.mat).emitted(cur, rec, rec.u, rec.v, rec.p);
+                if (paths.bsdf_pdf[p] > 0 && emission.len_sqrd() > 0) {
+                    emission *= power_heuristic(paths.bsdf_pdf[p], light_pdf(paths.prev_p[p], cur.direction(), *lights));
+                }
+                radiance_add(paths, p, emission);
+
+                scatter_record &srec = paths.srec[p];
+                sample_dim(bounce, sample_dims::bsdf);
+                if (!material_of(rec.mat).scatter(cur, rec, srec)) {
+                    continue;
+                }
+
+                if (srec.skip_pdf) {
+                    paths.throughput[p] = paths.throughput[p] * srec.atten;
+                    paths.set_ray(p, srec.skip_pdf_ray);
+                    paths.bsdf_pdf[p] = 0;
+                    if (survives_roulette(bounce, paths.throughput[p])) {
+                        next.push_back(p);
+                    }
+                } else {
+                    sample_dim(bounce, sample_dims::light);
+                    vec3 dir = light_direction(rec.p, *lights);
+                    paths.shadow_dir[p] = dir;
+                    paths.shadow_pdf[p] = light_pdf(rec.p, dir, *lights);
+                    shadows.push_back(p);
+                }
+            }
+        }
+
+        /*
+            Traces the shadow rays picked in the shade stage (in packets when packet_size is set)
+            and adds what they find, then extends each of those paths with a sample of its
+            material's pdf
+        */
+        void shadow_stage(path_queue &paths, const std::vector<int> &shadows, std::vector<int> &next, int bounce,
+                          const hittable &world, const hittable &lights) {
+            sampler_scope scope;
+
+            std::vector<int> traced;
+            std::vector<ray> rays;
+            for (int p : shadows) {
+                if (paths.shadow_pdf[p] > 0) {
+                    traced.push_back(p);
+                    rays.emplace_back(paths.rec[p].p, paths.shadow_dir[p], paths.time[p]);
+                }
+            }
+
+            std::vector<hit_record> lrecs(traced.size());
+            std::vector<hit_record*> recs;
+            for (auto &lrec : lrecs) {
+                recs.push_back(&lrec);
+            }
+
+            std::vector<char> found(traced.size());
+            trace_rays(paths, traced, rays, recs, found, world);
+
+            for (size_t q = 0; q < traced.size(); q++) {
+                scope.use(paths.stream[traced[q]]);
+                if (found[q]) {
+                    surface_record light = lrecs[q].finalize(rays[q]);
+                    paths.shadow_light[traced[q]] = material_of(light.mat).emitted(rays[q], light, light.u, light.v, light.p);
+                } else {
+                    paths.shadow_light[traced[q]] = background(rays[q]);
+                }
+            }
+
+            for (int p : shadows) {
+                scope.use(paths.stream[p]);
+                ray cur = paths.current(p);
+                const surface_record &rec = paths.rec[p];
+                const scatter_record &srec = paths.srec[p];
+                const pdf &mat_pdf = *srec.pdf_ptr();
+
+                if (paths.shadow_pdf[p] > 0) {
+                    ray shadow(rec.p, paths.shadow_dir[p], cur.time());
+                    radiance_add(paths, p, light_contribution(cur, rec, srec, mat_pdf, shadow, paths.shadow_pdf[p],
+                                                              paths.shadow_light[p]));
+                }
+
+                sample_dim(bounce, sample_dims::bsdf);
+                ray scattered = ray(rec.p, mat_pdf.generate(), cur.time());
+                double bsdf_pdf = mat_pdf.value(scattered.direction());
+                paths.bsdf_pdf[p] = bsdf_pdf;
+
+                if (bsdf_pdf > 0) {
+                    double scattering_pdf = material_of(rec.mat).scattering_pdf(cur, rec, scattered);
+                    paths.throughput[p] = paths.throughput[p] * srec.atten * scattering_pdf / bsdf_pdf;
+                    paths.prev_p[p] = rec.p;
+                    paths.set_ray(p, scattered);
+
+                    if (survives_roulette(bounce, paths.throughput[p])) {
+                        next.push_back(p);
+                    }
+                }
+            }
+        }
+
+        static void radiance_add(path_queue &paths, int p, const color &light) {
+            paths.radiance[p] += paths.throughput[p] * light;
+        }
+
+        /*
+            Square tiles covering the image in Hilbert curve order, so tiles next to each other
+            in the list are next to each other in the image. The pool hands each worker a
+            contiguous run of them
+        */
+        std::vector<tile> hilbert_tiles() const {
+            int size = std::max(tile_size, 1);
+            int nx = (img_wd + size - 1) / size;
+            int ny = (img_ht + size - 1) / size;
+
+            int n = 1;
+            while (n < nx || n < ny) n *= 2;
+
+            std::vector<tile> tiles;
+            tiles.reserve(size_t(nx) * ny);
+
+            for (long long d = 0; d < (long long)n * n; d++) {
+                int tx, ty;
+                hilbert_point(n, d, tx, ty);
+                if (tx >= nx || ty >= ny) {
+                    continue;
+                }
+
+                tile t;
+                t.x0 = tx * size;
+                t.y0 = ty * size;
+                t.x1 = std::min(t.x0 + size, img_wd);
+                t.y1 = std::min(t.y0 + size, img_ht);
+                tiles.push_back(t);
+            }
+
+            return tiles;
+        }
+
+        // point d along the Hilbert curve filling an n x n grid, n a power of two
+        static void hilbert_point(int n, long long d, int &x, int &y) {
+            x = y = 0;
+            for (int s = 1; s < n; s *= 2) {
+                int rx = int(1 & (d / 2));
+                int ry = int(1 & (d ^ rx));
+
+                if (ry == 0) {
+                    if (rx == 1) {
+                        x = s - 1 - x;
+                        y = s - 1 - y;
+                    }
+                    std::swap(x, y);
+                }
+
+                x += s * rx;
+                y += s * ry;
+                d /= 4;
+            }
+        }
+
+        // checkpoints are taken between passes, so a checkpointed render always runs in them
+        bool in_passes() const {
+            return progressive || !checkpoint_path.empty();
+        }
+
+        int adaptive_max_spp() const {
+            return int(strata.size()) * std::max(adaptive_max_scale, 1);
+        }
+
+        /*
+            Renders the image: for a coordinator when connect_addr is set, streamed to out_path,
+            or in passes
+        */
+        void render_image(const hittable &world, const hittable *lights) {
+            wave_times.reset();
+            select_kernel(lights);
+
+            if (!connect_addr.empty()) {
+                render_for_coordinator(world, lights);
+            } else if (stream && !adaptive && !progressive && serve_addr.empty()) {
+                render_streamed(world, lights);
+            } else {
+                render_passes(world, lights);
+            }
+
+            if (wavefront) {
+                wave_times.report();
+            }
+        }
+
+        /*
+            Renders the image in passes into per pixel accumulators. Without adaptive or
+            progressive set there is a single pass of strata.size() samples per pixel. Targets
+            are picked between passes on one thread so the image does not depend on the thread
+            count
+        */
+        void render_passes(const hittable &world, const hittable *lights) {
+
+            ThreadPool &pool = render_pool();
+            std::vector<tile> tiles = hilbert_tiles();
+
+            size_t pixels = size_t(img_wd) * img_ht;
+            int base_spp = int(strata.size());
+            int max_spp = adaptive ? adaptive_max_spp() : base_spp;
+
+            int first_spp = base_spp;
+            if (adaptive) {
+                first_spp = std::clamp(adaptive_min_spp, 2, base_spp);
+            } else if (in_passes()) {
+                first_spp = std::clamp(pass_spp, 1, base_spp);
+            }
+
+            film = framebuffer(img_wd, img_ht);
+            std::vector<int> targets(pixels, first_spp);
+
+            long long budget = (long long)base_spp * pixels;
+            long long used = 0;
+
+            auto next_targets = [&]() {
+                return adaptive ? next_adaptive_targets(targets, budget - used, max_spp)
+                                : next_pass_targets(targets, base_spp);
+            };
+
+            int pass = 0;
+            double resumed_time = 0;    // seconds spent before the checkpoint we resumed from
+            bool more = true;
+
+            if (resume && load_checkpoint(pass, resumed_time)) {
+                for (size_t k = 0; k < pixels; k++) {
+                    used += film.samples(k);
+                    targets[k] = film.samples(k);
+                }
+                std::clog << "\nResuming after pass " << pass << ", " << used << " samples\n" << std::flush;
+
+                // the same targets the interrupted render would have picked next
+                more = next_targets();
+            }
+
+            render_coordinator coordinator;
+            if (!serve_addr.empty() && !coordinator.listen(serve_addr, scene_id, checkpoint_config())) {
+                return;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            auto last_checkpoint = start;
+
+            while (more) {
+                auto pass_start = std::chrono::steady_clock::now();
+
+                for (size_t k = 0; k < pixels; k++) {
+                    used += targets[k] - film.samples(k);
+                }
+
+                if (!serve_addr.empty()) {
+                    render_remote(coordinator, tiles, targets, max_spp);
+                } else {
+                    std::vector<std::function<void()>> jobs;
+                    jobs.reserve(tiles.size());
+                    for (const auto &t : tiles) {
+                        jobs.emplace_back([this, &world, lights, &targets, max_spp, &t]() {
+                            render_tile(t, world, lights, targets, max_spp);
+                        });
+                    }
+                    pool.enqueue_batch(std::move(jobs));
+                    pool.wait_till_done();
+                }
+                pass++;
+
+                auto now = std::chrono::steady_clock::now();
+                double elapsed = resumed_time + std::chrono::duration<double>(now - start).count();
+                double pass_time = std::chrono::duration<double>(now - pass_start).count();
+
+                if (progressive) {
+                    save_image();
+                    std::clog << "\nPass " << pass << ": " << used << " samples, "
+                              << elapsed << "s\n" << std::flush;
+                }
+
+                // stop before a pass that would run past the time budget
+                if (progressive && time_budget > 0 && elapsed + pass_time > time_budget) {
+                    more = false;
+                } else {
+                    more = next_targets();
+                }
+
+                double since_checkpoint = std::chrono::duration<double>(now - last_checkpoint).count();
+                if (!checkpoint_path.empty() && (!more || since_checkpoint >= checkpoint_interval)) {
+                    if (!save_checkpoint(pass, elapsed)) {
+                        std::cerr << "\nCheckpoint not saved, " << checkpoint_path << " still holds the last one" << std::flush;
+                    }
+                    last_checkpoint = now;
+                }
+            }
+
+            coordinator.finish();
+
+            if (adaptive) {
+                std::clog << "\nAdaptive: " << used << " samples of " << budget << " budget\n" << std::flush;
+                write_sample_heatmap(max_spp);
+            }
+
+            if (!progressive) {
+                save_image();
+            }
+
+            writer.wait();
+        }
+
+        /*
+            One pass on worker processes. A job is a tile and the sample range every pixel of it
+            takes; the worker sends back the pass's per pixel sums, which fold into the film just
+            like a local tile's, so the image does not depend on how many workers there were
+        */
+        void render_remote(render_coordinator &coordinator, const std::vector<tile> &tiles,
+                           const std::vector<int> &targets, int spp) {
+            std::vector<std::string> jobs;
+            std::vector<const tile*> job_tiles;
+
+            for (const auto &t : tiles) {
+                msg_writer w;
+                w.put(t.x0);
+                w.put(t.y0);
+                w.put(t.x1);
+                w.put(t.y1);
+                w.put(spp);
+
+                bool any = false;
+                for (int j = t.y0; j < t.y1; j++) {
+                    for (int i = t.x0; i < t.x1; i++) {
+                        size_t k = size_t(j) * img_wd + i;
+                        w.put(film.samples(k));
+                        w.put(targets[k]);
+                        any = any || targets[k] > film.samples(k);
+                    }
+                }
+
+                if (any) {
+                    jobs.push_back(std::move(w.buf));
+                    job_tiles.push_back(&t);
+                }
+            }
+
+            coordinator.run(jobs, [&](int id, msg_reader &r) {
+                const tile &t = *job_tiles[id];
+
+                // id, then 5 doubles and a count per pixel; nothing is added from a short result
+                size_t pixels = size_t(t.x1 - t.x0) * (t.y1 - t.y0);
+                if (r.buf.size() != sizeof(int) + pixels * (5 * sizeof(double) + sizeof(int))) {
+                    return false;
+                }
+
+                for (int j = t.y0; j < t.y1; j++) {
+                    for (int i = t.x0; i < t.x1; i++) {
+                        sample_sum s;
+                        double x = 0, y = 0, z = 0;
+                        r.get(x);
+                        r.get(y);
+                        r.get(z);
+                        r.get(s.lum_sum);
+                        r.get(s.lum_sqrd);
+                        r.get(s.n);
+                        s.sum = color(x, y, z);
+                        film.add(size_t(j) * img_wd + i, s);
+                    }
+                }
+                return true;
+            });
+        }
+
+        /*
+            Worker side of a distributed render. The scene was rebuilt from the same command
+            line, so it only takes jobs from the coordinator, renders them on the pool and sends
+            the sums back until the coordinator says the frame is done. Nothing is written here
+        */
+        void render_for_coordinator(const hittable &world, const hittable *lights) {
+            ThreadPool &pool = render_pool();
+            render_worker_link link;
+
+            if (!link.connect(connect_addr, scene_id, checkpoint_config(), int(pool.size()))) {
+                return;
+            }
+
+            std::mutex results_mutex;
+            std::vector<std::string> results;
+            int in_flight = 0;
+            bool done = false;
+
+            while (!done) {
+                std::vector<std::string> ready;
+                {
+                    std::lock_guard<std::mutex> lock(results_mutex);
+                    ready.swap(results);
+                }
+
+                for (const auto &res : ready) {
+                    if (!link.send(net::RESULT, res)) {
+                        done = true;
+                    }
+                    in_flight--;
+                }
+
+                if (done) {
+                    break;
+                }
+
+                // finished jobs are sent at the next wake up, with none running only the coordinator can wake us
+                uint32_t type;
+                std::string payload;
+                int got = link.poll_msg(type, payload, in_flight > 0 ? 20 : 1000);
+                if (got < 0 || (got > 0 && type == net::DONE)) {
+                    done = true;
+                } else if (got > 0 && type == net::WORK) {
+                    in_flight++;
+                    pool.enqueue([this, &world, lights, &results_mutex, &results, job = std::move(payload)]() {
+                        std::string res = render_job(job, world, lights);
+                        std::lock_guard<std::mutex> lock(results_mutex);
+                        results.push_back(std::move(res));
+                    });
+                }
+            }
+
+            // the coordinator is gone or done with the frame, so jobs still running are not wanted
+            pool.wait_till_done();
+        }
+
+        // renders one job from the coordinator, the result starts with the job's id
+        std::string render_job(const std::string &job, const hittable &world, const hittable *lights) {
+            msg_reader r(job);
+            int id = -1, spp = 1;
+            tile t{0, 0, 0, 0};
+            r.get(id);
+            r.get(t.x0);
+            r.get(t.y0);
+            r.get(t.x1);
+            r.get(t.y1);
+            r.get(spp);
+
+            // a job that does not fit the image gets an empty result, which the coordinator rejects
+            if (t.x0 < 0 || t.y0 < 0 || t.x1 > img_wd || t.y1 > img_ht) {
+                t = tile{0, 0, 0, 0};
+            }
+
+            size_t pixels = size_t(std::max(t.x1 - t.x0, 0)) * std::max(t.y1 - t.y0, 0);
+            std::vector<int> from(pixels, 0), to(pixels, 0);
+            for (size_t q = 0; q < pixels; q++) {
+                r.get(from[q]);
+                r.get(to[q]);
+            }
+
+            std::vector<sample_sum> sums = sample_tile(t, from, to, spp, world, lights);
+
+            msg_writer w;
+            w.put(id);
+
+            for (const auto &pass : sums) {
+                w.put(double(pass.sum.x()));
+                w.put(double(pass.sum.y()));
+                w.put(double(pass.sum.z()));
+                w.put(pass.lum_sum);
+                w.put(pass.lum_sqrd);
+                w.put(pass.n);
+            }
+
+            return w.buf;
+        }
+
+        /*
+            Single pass render that never holds the whole image. Bands of tile_size rows are
+            rendered a few at a time; each band is written to out_path as soon as it and every
+            band above it are done, and its memory is reused for a band further down. The
+            framebuffer returned by image() stays empty
+        */
+        void render_streamed(const hittable &world, const hittable *lights) {
+            ThreadPool &pool = render_pool();
+
+            int spp = int(strata.size());
+            int band_ht = std::max(tile_size, 1);
+            int bands = (img_ht + band_ht - 1) / band_ht;
+            int tiles_per_band = (img_wd + band_ht - 1) / band_ht;
+
+            // enough bands in flight to keep every thread busy while the top one finishes
+            int window = std::max(2, (2 * int(pool.size()) + tiles_per_band - 1) / tiles_per_band + 1);
+
+            struct band {
+                framebuffer fb;
+                std::atomic<int> left{0};
+            };
+            std::vector<std::unique_ptr<band>> ring;
+            for (int b = 0; b < window; b++) {
+                ring.push_back(std::make_unique<band>());
+            }
+
+            std::mutex done_mutex;
+            std::condition_variable band_done;
+            std::vector<char> done(bands, 0);
+
+            auto submit = [&](int b) {
+                band &bd = *ring[b % window];
+                int y0 = b * band_ht;
+                int y1 = std::min(y0 + band_ht, img_ht);
+                bd.fb = framebuffer(img_wd, y1 - y0);
+
+                std::vector<std::function<void()>> jobs;
+                for (int x0 = 0; x0 < img_wd; x0 += band_ht) {
+                    tile t{x0, y0, std::min(x0 + band_ht, img_wd), y1};
+                    jobs.emplace_back([this, &world, lights, &bd, &done_mutex, &band_done, &done, t, b, spp]() {
+                        render_band_tile(t, bd.fb, world, lights, spp);
+                        if (--bd.left == 0) {
+                            std::lock_guard<std::mutex> lock(done_mutex);
+                            done[b] = 1;
+                            band_done.notify_one();
+                        }
+                    });
+                }
+
+                bd.left = int(jobs.size());
+                pool.enqueue_batch(std::move(jobs));
+            };
+
+            image_stream out;
+            out.open(out_path, out_format, img_wd, img_ht);
+            double scale = double(strata.size()) * anti_alias_scale;
+
+            int next = 0;
+            for (; next < std::min(window, bands); next++) {
+                submit(next);
+            }
+
+            for (int b = 0; b < bands; b++) {
+                {
+                    std::unique_lock<std::mutex> lock(done_mutex);
+                    band_done.wait(lock, [&done, b] { return done[b] != 0; });
+                }
+
+                out.write(ring[b % window]->fb, scale, is_hdr, gamma);
+
+                if (next < bands) {
+                    submit(next++);
+                }
+            }
+
+            pool.wait_till_done();
+            out.close();
+            film = framebuffer();
+        }
+
+        // one tile of a band, band holds the rows of the tile
+        void render_band_tile(const tile &t, framebuffer &band, const hittable &world, const hittable *lights, int spp) {
+            size_t pixels = size_t(t.x1 - t.x0) * (t.y1 - t.y0);
+            std::vector<sample_sum> sums = sample_tile(t, std::vector<int>(pixels, 0), std::vector<int>(pixels, spp),
+                                                       spp, world, lights);
+
+            size_t q = 0;
+            for (int j = t.y0; j < t.y1; j++) {
+                for (int i = t.x0; i < t.x1; i++) {
+                    band.add(size_t(j - t.y0) * img_wd + i, sums[q++]);
+                }
+            }
+        }
+
+        /*
+            Everything that decides which samples a render takes. A checkpoint only resumes a
+            render with the same values. The scene is only told apart by scene_id, edits to the
+            scene behind an id are up to the caller
+        */
+        std::vector<double> checkpoint_config() const {
+            return {
+                double(scene_id), double(img_wd), double(img_ht), double(strata.size()), double(max_depth), double(rr_depth),
+                double(int(sampler)), double(seed),
+                fov, defocus_angle, focus_dist,
+                lk_from.x(), lk_from.y(), lk_from.z(), lk_at.x(), lk_at.y(), lk_at.z(), vup.x(), vup.y(), vup.z(),
+                double(adaptive), adaptive_threshold, double(adaptive_min_spp), double(adaptive_max_scale),
+                double(pass_spp), double(sample_env), double(bool(env))
+            };
+        }
+
+        /*
+            Checkpoint file: magic, the render config, passes done, seconds spent and the
+            framebuffer. Samples are a function of (seed, pixel, sample index), so the per pixel
+            counts in the framebuffer are all the random state there is to save
+        */
+        bool save_checkpoint(int pass, double elapsed) const {
+            std::ostringstream out(std::ios::binary);
+            std::vector<double> config = checkpoint_config();
+            int count = int(config.size());
+
+            out.write(checkpoint_magic, sizeof(checkpoint_magic));
+            out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            out.write(reinterpret_cast<const char*>(config.data()), config.size() * sizeof(double));
+            out.write(reinterpret_cast<const char*>(&pass), sizeof(pass));
+            out.write(reinterpret_cast<const char*>(&elapsed), sizeof(elapsed));
+            film.save(out);
+
+            return write_file(checkpoint_path, out.str());
+        }
+
+        bool load_checkpoint(int &pass, double &elapsed) {
+            std::ifstream in(checkpoint_path, std::ios::binary);
+            if (!in) {
+                return false;
+            }
+
+            char magic[sizeof(checkpoint_magic)];
+            int count = 0;
+            in.read(magic, sizeof(magic));
+            in.read(reinterpret_cast<char*>(&count), sizeof(count));
+
+            std::vector<double> config = checkpoint_config();
+            if (!in || std::memcmp(magic, checkpoint_magic, sizeof(magic)) != 0 || count != int(config.size())) {
+                std::cerr << "\nNot a checkpoint of this render: " << checkpoint_path << std::flush;
+                return false;
+            }
+
+            std::vector<double> saved(count);
+            in.read(reinterpret_cast<char*>(saved.data()), saved.size() * sizeof(double));
+            if (!in || saved != config) {
+                std::cerr << "\nCheckpoint was taken with other settings: " << checkpoint_path << std::flush;
+                return false;
+            }
+
+            framebuffer loaded;
+            in.read(reinterpret_cast<char*>(&pass), sizeof(pass));
+            in.read(reinterpret_cast<char*>(&elapsed), sizeof(elapsed));
+            if (!in || !loaded.load(in) || loaded.width() != img_wd || loaded.height() != img_ht) {
+                std::cerr << "\nCheckpoint is damaged: " << checkpoint_path << std::flush;
+                pass = 0;
+                elapsed = 0;
+                return false;
+            }
+
+            film = std::move(loaded);
+            return true;
+        }
+
+        /*
+            Uniform passes of pass_spp samples until every pixel has base_spp
+        */
+        bool next_pass_targets(std::vector<int> &targets, int base_spp) const {
+            bool more = false;
+            for (size_t k = 0; k < film.size(); k++) {
+                targets[k] = std::min(base_spp, film.samples(k) + std::max(pass_spp, 1));
+                more |= targets[k] > film.samples(k);
+            }
+
+            return more;
+        }
+
+        /*
+            Adaptive sampling. After the first adaptive_min_spp samples, passes hand out what is
+            left of the fixed budget (strata.size() samples per pixel) to the pixels still above
+            adaptive_threshold, in proportion to their error
+        */
+        bool next_adaptive_targets(std::vector<int> &targets, long long left, int max_spp) const {
+            size_t pixels = film.size();
+
+            // pixels still too noisy, and their summed error
+            std::vector<double> errors = window_errors();
+            std::vector<size_t> active;
+            double err_sum = 0;
+            for (size_t k = 0; k < pixels; k++) {
+                if (film.samples(k) < max_spp && errors[k] > adaptive_threshold) {
+                    active.push_back(k);
+                    err_sum += std::fmin(errors[k], 1.0);
+                }
+            }
+
+            if (active.empty() || left < 2 * (long long)active.size()) {
+                return false;
+            }
+
+            // spend about half of what is left per pass so the estimates get to catch up,
+            // progressive passes take at most pass_spp samples per pixel on average
+            double pass_budget = 0.5 * double(left);
+            if (in_passes()) {
+                pass_budget = std::fmin(pass_budget, double(std::max(pass_spp, 1)) * pixels);
+            }
+
+            for (size_t k : active) {
+                double share = pass_budget * std::fmin(errors[k], 1.0) / err_sum;
+                targets[k] = std::min(max_spp, film.samples(k) + std::max(1, int(share)));
+            }
+
+            return true;
+        }
+
+        /*
+            Error of every pixel taken as the largest error in its 3x3 neighbourhood. Small bright
+            features (the sun, caustics) that one pixel's first samples all missed still show up
+            as noise in a neighbour, which keeps the pixel sampling
+        */
+        std::vector<double> window_errors() const {
+            std::vector<double> own(film.size());
+            for (size_t k = 0; k < film.size(); k++) {
+                own[k] = film.rel_error(k);
+            }
+
+            std::vector<double> errors(film.size(), 0.0);
+            for (int j = 0; j < img_ht; j++) {
+                for (int i = 0; i < img_wd; i++) {
+                    double &err = errors[j * img_wd + i];
+                    for (int y = std::max(j - 1, 0); y <= std::min(j + 1, img_ht - 1); y++) {
+                        for (int x = std::max(i - 1, 0); x <= std::min(i + 1, img_wd - 1); x++) {
+                            err = std::fmax(err, own[y * img_wd + x]);
+                        }
+                    }
+                }
+            }
+
+            return errors;
+        }
+
+        /*
+            Writes the image to out_path on the writer thread. The framebuffer is copied first so
+            the next pass can keep rendering into it
+        */
+        void save_image() {
+            // keeps the brightness of the summed estimator: sum * anti_alias_scale
+            double scale = double(strata.size()) * anti_alias_scale;
+
+            auto snapshot = std::make_shared<framebuffer>(film);
+            writer.submit([snapshot, scale, path = out_path, format = out_format, hdr = is_hdr, g = gamma]() {
+                write_image(path, format, *snapshot, scale, hdr, g);
+            });
+        }
+
+        /*
+            Writes samples.ppm, samples taken per pixel from blue (few) to red (max_spp)
+        */
+        void write_sample_heatmap(int max_spp) const {
+            image_8bit img;
+            img.width = img_wd;
+            img.height = img_ht;
+            img.data.resize(3 * film.size());
+
+            for (size_t k = 0; k < film.size(); k++) {
+                double t = double(film.samples(k)) / max_spp;
+                auto ramp = [t](double c) { return std::clamp(1.5 - std::fabs(4 * t - c), 0.0, 1.0); };
+
+                img.data[3 * k] = static_cast<unsigned char>(255.999 * ramp(3));
+                img.data[3 * k + 1] = static_cast<unsigned char>(255.999 * ramp(2));
+                img.data[3 * k + 2] = static_cast<unsigned char>(255.999 * ramp(1));
+            }
+
+            write_ppm("samples.ppm", img);
+        }
+
+        static void sample_dim(int bounce, sample_dims::step step) {
+            thread_sampler().set_dimension(sample_dims::of_bounce(bounce, step));
         }
 };
 
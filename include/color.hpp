@@ -5,6 +5,7 @@
 #include "interval.hpp"
 #include "perlin.hpp"
 #include "rtw_stb_image.hpp"
+#include "arena.hpp"
 
 #include <iostream>
 #include <memory>
@@ -17,6 +18,10 @@ using color = vec3;
 
 double pi_col = 3.14159265;
 
+inline double luminance(const color &col) {
+    return 0.2126 * col.x() + 0.7152 * col.y() + 0.0722 * col.z();
+}
+
 inline double lin_to_gamma(double lin_comp) {
     if (lin_comp > 0) {
         return std::sqrt(lin_comp);
@@ -33,7 +38,10 @@ color toneMap(const color &hdrcolor) {
     return mapped;
 }
 
-std::string write_color(color &col, int aa, bool is_hdr = false, double gamma = 1.0) {
+/*
+    Display value of a linear color, every channel in [0, 0.999]
+*/
+inline color to_display(const color &col, bool is_hdr = false, double gamma = 1.0) {
     color out = col;
 
     interval intens(0.000, 0.999);
@@ -62,14 +70,7 @@ std::string write_color(color &col, int aa, bool is_hdr = false, double gamma =
         );
     }
 
-    out = color(intens.clamp(out.x()), intens.clamp(out.y()), intens.clamp(out.z()));        
-
-    // Scale to [0, 255] and convert to integers
-    int r = static_cast<int>(255.999 * out.x());
-    int g = static_cast<int>(255.999 * out.y());
-    int b = static_cast<int>(255.999 * out.z());
-
-    return std::to_string(r) + ' ' + std::to_string(g) + ' ' + std::to_string(b) + '\n';
+    return color(intens.clamp(out.x()), intens.clamp(out.y()), intens.clamp(out.z()));
 }
 
 
@@ -99,7 +100,7 @@ class checkers : public texture {
             : inv_scale(1.0 / scale), even(even), odd(odd) {}
 
         checkers(double scale, const color &col1, const color &col2)
-            : checkers(scale, make_shared<solid_color>(col1), make_shared<solid_color>(col2)) {}
+            : checkers(scale, scene_make<solid_color>(col1), scene_make<solid_color>(col2)) {}
 
         color value(double u, double v, const vec3 &p) const override {
             auto x = int(std::floor(inv_scale * p.x()));
@@ -193,6 +194,15 @@ class image_hdr_tex : public texture {
             return color(pix[0], pix[1], pix[2]);            
         }
 
+        int img_width() const { return img_data ? width : 0; }
+        int img_height() const { return img_data ? height : 0; }
+
+        // texel i, j with row 0 at v = 1
+        color pixel(int i, int j) const {
+            float* pix = img_data + j * bytes_per_line + i * bytes_per_pixel;
+            return color(pix[0], pix[1], pix[2]);
+        }
+
     private:
         int width;
         int height;
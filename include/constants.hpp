@@ -8,6 +8,8 @@
 #include <vector>
 #include <cstdlib>
 
+#include "sampler.hpp"
+
 // c++ std usings
 using std::make_shared;
 using std::shared_ptr;
@@ -19,6 +21,9 @@ const double default_aspect = 16.0 / 9.0;
 const int default_max_depth = 15;
 const int default_anti_alias = 15;
 const int default_fov = 90;
+const int default_rr_depth = 5;
+const double default_adaptive_threshold = 0.02;
+const int default_tile_size = 16;
 
 const double pi = 3.14159265;
 const double inf = std::numeric_limits<double>::infinity();
@@ -28,7 +33,7 @@ inline double deg_to_rad(double degrees) {
 };
 
 inline double rand_double() {
-    return std::rand() / (RAND_MAX + 1.0);
+    return thread_sampler().next();
 }
 
 inline double rand_double(double min, double max) {
@@ -0,0 +1,579 @@
+#ifndef DISTRIBUTED_HPP
+#define DISTRIBUTED_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+    Coordinator / worker rendering over sockets. Addresses are "unix:<path>" for a Unix domain
+    socket or "<host>:<port>" for TCP. Messages are a type, a length and a payload of plain
+    native endian values, so every process has to run on the same architecture
+*/
+namespace net {
+    enum msg_type : uint32_t {
+        HELLO = 1,      // worker -> coordinator: scene id, render config, threads
+        ACCEPT,         // coordinator -> worker
+        REJECT,         // coordinator -> worker, config does not match
+        WORK,           // coordinator -> worker: job id, job
+        RESULT,         // worker -> coordinator: job id, result
+        DONE            // coordinator -> worker: the frame is finished
+    };
+
+    inline bool send_all(int fd, const void *data, size_t len) {
+        const char *p = static_cast<const char*>(data);
+        while (len > 0) {
+            ssize_t n = ::send(fd, p, len, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            len -= size_t(n);
+        }
+        return true;
+    }
+
+    inline bool recv_all(int fd, void *data, size_t len) {
+        char *p = static_cast<char*>(data);
+        while (len > 0) {
+            ssize_t n = ::recv(fd, p, len, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            len -= size_t(n);
+        }
+        return true;
+    }
+
+    inline bool send_msg(int fd, uint32_t type, const std::string &payload) {
+        uint32_t head[2] = {type, uint32_t(payload.size())};
+        return send_all(fd, head, sizeof(head)) && send_all(fd, payload.data(), payload.size());
+    }
+
+    // longest payload a peer may send, far above any tile's
+    const uint32_t max_payload = 64u << 20;
+
+    inline bool recv_msg(int fd, uint32_t &type, std::string &payload) {
+        uint32_t head[2];
+        if (!recv_all(fd, head, sizeof(head)) || head[1] > max_payload) {
+            return false;
+        }
+
+        type = head[0];
+        payload.resize(head[1]);
+        return recv_all(fd, &payload[0], payload.size());
+    }
+
+    /*
+        Bounds how long a blocking send or recv on fd may wait, so a stalled peer can't hang the
+        caller, whether it stopped writing or stopped reading
+    */
+    inline void set_timeouts(int fd, double seconds) {
+        timeval tv{};
+        tv.tv_sec = time_t(seconds);
+        tv.tv_usec = suseconds_t((seconds - double(tv.tv_sec)) * 1e6);
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+
+    /*
+        Splits "host:port", false for unix: addresses. A missing host means loopback; there is
+        no authentication, so other machines are only let in when the host is given explicitly
+        (e.g. "0.0.0.0:port")
+    */
+    inline bool split_host(const std::string &addr, std::string &host, std::string &port) {
+        if (addr.rfind("unix:", 0) == 0) {
+            return false;
+        }
+
+        auto colon = addr.find_last_of(':');
+        host = colon == std::string::npos ? "" : addr.substr(0, colon);
+        port = colon == std::string::npos ? addr : addr.substr(colon + 1);
+        if (host.empty()) host = "127.0.0.1";
+        return true;
+    }
+
+    inline int listen_on(const std::string &addr) {
+        std::string host, port;
+
+        if (!split_host(addr, host, port)) {
+            std::string path = addr.substr(5);
+            int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+            sockaddr_un sa{};
+            sa.sun_family = AF_UNIX;
+            std::strncpy(sa.sun_path, path.c_str(), sizeof(sa.sun_path) - 1);
+            ::unlink(path.c_str());
+
+            if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) < 0 || ::listen(fd, 64) < 0) {
+                std::cerr << "\nCan't listen on " << addr << ": " << std::strerror(errno) << std::flush;
+                if (fd >= 0) ::close(fd);
+                return -1;
+            }
+            return fd;
+        }
+
+        addrinfo hints{}, *res = nullptr;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        if (::getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0 || !res) {
+            std::cerr << "\nBad address " << addr << std::flush;
+            return -1;
+        }
+
+        int fd = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        int yes = 1;
+        if (fd >= 0) ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+        if (fd < 0 || ::bind(fd, res->ai_addr, res->ai_addrlen) < 0 || ::listen(fd, 64) < 0) {
+            std::cerr << "\nCan't listen on " << addr << ": " << std::strerror(errno) << std::flush;
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+        }
+
+        ::freeaddrinfo(res);
+        return fd;
+    }
+
+    // keeps trying for timeout seconds, so workers may start before the coordinator
+    inline int connect_to(const std::string &addr, double timeout) {
+        auto start = std::chrono::steady_clock::now();
+        std::string host, port;
+        bool tcp = split_host(addr, host, port);
+
+        while (true) {
+            int fd = -1;
+
+            if (!tcp) {
+                sockaddr_un sa{};
+                sa.sun_family = AF_UNIX;
+                std::strncpy(sa.sun_path, addr.substr(5).c_str(), sizeof(sa.sun_path) - 1);
+
+                fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+                if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) == 0) {
+                    return fd;
+                }
+            } else {
+                addrinfo hints{}, *res = nullptr;
+                hints.ai_family = AF_UNSPEC;
+                hints.ai_socktype = SOCK_STREAM;
+                if (::getaddrinfo(host.c_str(), port.c_str(), &hints, &res) == 0 && res) {
+                    fd = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+                    if (fd >= 0 && ::connect(fd, res->ai_addr, res->ai_addrlen) == 0) {
+                        int yes = 1;
+                        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+                        ::freeaddrinfo(res);
+                        return fd;
+                    }
+                    ::freeaddrinfo(res);
+                }
+            }
+
+            if (fd >= 0) ::close(fd);
+
+            double waited = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (waited > timeout) {
+                std::cerr << "\nCan't connect to " << addr << std::flush;
+                return -1;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+}
+
+/*
+    Builds a message payload out of plain values
+*/
+struct msg_writer {
+    std::string buf;
+
+    template <typename T>
+    void put(const T &v) { buf.append(reinterpret_cast<const char*>(&v), sizeof(T)); }
+};
+
+/*
+    Reads plain values back out of a payload, in the order they were put
+*/
+struct msg_reader {
+    const std::string &buf;
+    size_t pos = 0;
+
+    msg_reader(const std::string &buf) : buf(buf) {}
+
+    template <typename T>
+    bool get(T &v) {
+        if (pos + sizeof(T) > buf.size()) return false;
+        std::memcpy(&v, buf.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+};
+
+inline std::string hello_payload(int scene_id, const std::vector<double> &config, int threads) {
+    msg_writer w;
+    w.put(scene_id);
+    w.put(threads);
+    w.put(int(config.size()));
+    for (double v : config) w.put(v);
+    return w.buf;
+}
+
+/*
+    Hands jobs out to worker processes and collects their results. Workers can join at any
+    time, each gets twice as many jobs as it has threads, and the jobs of a worker that drops
+    out, or whose result does not read back, go back in the queue. A worker has handshake_time
+    seconds to say hello, no single send or receive waits longer than io_time, and a worker
+    that sits on a job far longer than jobs usually take loses it (see expire_stalled), so a
+    peer that stalls is dropped instead of stalling the render
+*/
+class render_coordinator {
+    public:
+        static constexpr double handshake_time = 5;
+        static constexpr double io_time = 10;
+        static constexpr double stall_factor = 8;       // a job out this many median job times is stalled
+        static constexpr double stall_time = 30;        // but never before this many seconds
+        static constexpr double first_result_time = 600;    // before any job of the pass came back
+
+        ~render_coordinator() { finish(); }
+
+        bool listen(const std::string &addr, int scene, const std::vector<double> &cfg) {
+            listen_fd = net::listen_on(addr);
+            scene_id = scene;
+            config = cfg;
+
+            if (listen_fd >= 0) {
+                std::clog << "\nServing tiles on " << addr << "\n" << std::flush;
+            }
+            return listen_fd >= 0;
+        }
+
+        /*
+            Runs every job on the workers, calling on_result(job, reader) on this thread as
+            results come in. on_result returns false for a result it could not read, which
+            runs the job again. Blocks until all jobs are done
+        */
+        void run(const std::vector<std::string> &jobs, const std::function<bool(int, msg_reader&)> &on_result) {
+            std::deque<int> pending;
+            for (int i = 0; i < int(jobs.size()); i++) {
+                pending.push_back(i);
+            }
+
+            std::vector<char> finished(jobs.size(), 0);
+            std::vector<double> job_times;      // seconds from sending a job to its result
+            size_t done = 0;
+            bool said_waiting = false;
+
+            while (done < jobs.size()) {
+                // keep every worker busy
+                for (size_t p = 0; p < peers.size();) {
+                    bool dropped = false;
+                    while (int(peers[p].in_flight.size()) < peers[p].slots && !pending.empty()) {
+                        int id = pending.front();
+                        pending.pop_front();
+                        peers[p].in_flight.push_back({id, std::chrono::steady_clock::now()});
+
+                        msg_writer w;
+                        w.put(id);
+                        if (!net::send_msg(peers[p].fd, net::WORK, w.buf + jobs[id])) {
+                            // the job being sent is in flight, so it goes back with the rest
+                            drop(p, pending);
+                            dropped = true;
+                            break;
+                        }
+                    }
+
+                    if (!dropped) p++;
+                }
+
+                if (peers.empty() && !said_waiting) {
+                    std::clog << "\nWaiting for workers\n" << std::flush;
+                    said_waiting = true;
+                }
+
+                expire_joining();
+                expire_stalled(job_times, pending);
+
+                std::vector<pollfd> fds;
+                fds.push_back({listen_fd, POLLIN, 0});
+                for (const auto &peer : peers) {
+                    fds.push_back({peer.fd, POLLIN, 0});
+                }
+                for (const auto &join : joining) {
+                    fds.push_back({join.fd, POLLIN, 0});
+                }
+
+                size_t polled_peers = peers.size();
+                size_t polled_joining = joining.size();
+                if (::poll(fds.data(), fds.size(), 1000) <= 0) {
+                    continue;
+                }
+
+                // results first, back to front so fds lines up with peers while peers are dropped
+                for (size_t f = polled_peers; f >= 1; f--) {
+                    if (!(fds[f].revents & (POLLIN | POLLHUP | POLLERR))) {
+                        continue;
+                    }
+
+                    size_t p = f - 1;
+                    uint32_t type;
+                    std::string payload;
+                    if (!net::recv_msg(peers[p].fd, type, payload) || type != net::RESULT) {
+                        drop(p, pending);
+                        continue;
+                    }
+
+                    msg_reader r(payload);
+                    int id = -1;
+                    r.get(id);
+
+                    auto &flight = peers[p].in_flight;
+                    for (size_t k = 0; k < flight.size(); k++) {
+                        if (flight[k].id == id) {
+                            job_times.push_back(seconds_since(flight[k].sent));
+                            flight.erase(flight.begin() + k);
+                            break;
+                        }
+                    }
+
+                    if (id < 0 || id >= int(jobs.size()) || finished[id]) {
+                        continue;
+                    }
+
+                    if (!on_result(id, r)) {
+                        std::cerr << "\nBad result for job " << id << ", running it again" << std::flush;
+                        pending.push_back(id);
+                        continue;
+                    }
+
+                    finished[id] = 1;
+                    done++;
+                    std::clog << "\rProgress: " << done << "/" << jobs.size() << "            " << std::flush;
+                }
+
+                // handshakes, back to front so finishing one keeps the others in place
+                for (size_t g = polled_joining; g-- > 0;) {
+                    if (fds[1 + polled_peers + g].revents & (POLLIN | POLLHUP | POLLERR)) {
+                        int fd = joining[g].fd;
+                        joining.erase(joining.begin() + g);
+                        if (greet(fd)) said_waiting = false;
+                    }
+                }
+
+                if (fds[0].revents & POLLIN) {
+                    accept_peer();
+                }
+            }
+        }
+
+        // tells the workers the frame is done and stops listening
+        void finish() {
+            for (auto &peer : peers) {
+                net::send_msg(peer.fd, net::DONE, "");
+                ::close(peer.fd);
+            }
+            peers.clear();
+
+            for (auto &join : joining) {
+                ::close(join.fd);
+            }
+            joining.clear();
+
+            if (listen_fd >= 0) {
+                ::close(listen_fd);
+                listen_fd = -1;
+            }
+        }
+
+    private:
+        struct job_out {
+            int id;
+            std::chrono::steady_clock::time_point sent;
+        };
+
+        struct peer {
+            int fd;
+            int slots;
+            std::vector<job_out> in_flight;
+        };
+
+        // a connection that has not said hello yet
+        struct joiner {
+            int fd;
+            std::chrono::steady_clock::time_point deadline;
+        };
+
+        int listen_fd = -1;
+        int scene_id = -1;
+        std::vector<double> config;
+        std::vector<peer> peers;
+        std::vector<joiner> joining;
+
+        // takes a connection; its hello is read once poll sees it arrive
+        void accept_peer() {
+            int fd = ::accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                return;
+            }
+
+            net::set_timeouts(fd, io_time);
+            auto deadline = std::chrono::steady_clock::now()
+                          + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(handshake_time));
+            joining.push_back({fd, deadline});
+        }
+
+        // closes connections that did not say hello in time
+        void expire_joining() {
+            auto now = std::chrono::steady_clock::now();
+            for (size_t g = joining.size(); g-- > 0;) {
+                if (now > joining[g].deadline) {
+                    std::cerr << "\nDropped a connection that never said hello" << std::flush;
+                    ::close(joining[g].fd);
+                    joining.erase(joining.begin() + g);
+                }
+            }
+        }
+
+        static double seconds_since(std::chrono::steady_clock::time_point t) {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+        }
+
+        /*
+            Drops the workers holding a job longer than stall_factor times the median time jobs
+            of this pass took from being sent to coming back. The time includes waiting behind
+            the worker's other jobs, hence the wide factor. Until a first job is back there is
+            nothing to compare against and only first_result_time applies
+        */
+        void expire_stalled(const std::vector<double> &job_times, std::deque<int> &pending) {
+            double limit = first_result_time;
+            if (!job_times.empty()) {
+                std::vector<double> sorted = job_times;
+                auto mid = sorted.begin() + sorted.size() / 2;
+                std::nth_element(sorted.begin(), mid, sorted.end());
+                limit = std::fmax(stall_time, stall_factor * *mid);
+            }
+
+            for (size_t p = peers.size(); p-- > 0;) {
+                for (const auto &job : peers[p].in_flight) {
+                    if (seconds_since(job.sent) > limit) {
+                        std::cerr << "\nWorker stalled on job " << job.id << ", running its jobs elsewhere" << std::flush;
+                        drop(p, pending);
+                        break;
+                    }
+                }
+            }
+        }
+
+        // reads the hello of a connection, true when it joined as a worker
+        bool greet(int fd) {
+            uint32_t type;
+            std::string payload;
+            if (!net::recv_msg(fd, type, payload) || type != net::HELLO) {
+                ::close(fd);
+                return false;
+            }
+
+            msg_reader r(payload);
+            int scene = -1, threads = 1, count = 0;
+            bool ok = r.get(scene) && r.get(threads) && r.get(count) && count == int(config.size());
+
+            std::vector<double> cfg(config.size());
+            for (auto &v : cfg) ok = ok && r.get(v);
+
+            if (!ok || scene != scene_id || cfg != config) {
+                std::cerr << "\nRejected a worker rendering other settings" << std::flush;
+                net::send_msg(fd, net::REJECT, "");
+                ::close(fd);
+                return false;
+            }
+
+            threads = std::clamp(threads, 1, 1024);
+            net::send_msg(fd, net::ACCEPT, "");
+            peers.push_back({fd, 2 * threads, {}});
+            std::clog << "\nWorker joined (" << threads << " threads), " << peers.size() << " connected\n" << std::flush;
+            return true;
+        }
+
+        void drop(size_t p, std::deque<int> &pending) {
+            for (const auto &job : peers[p].in_flight) {
+                pending.push_front(job.id);
+            }
+
+            ::close(peers[p].fd);
+            peers.erase(peers.begin() + p);
+            std::clog << "\nWorker left, " << peers.size() << " connected\n" << std::flush;
+        }
+};
+
+/*
+    Worker end of the connection
+*/
+class render_worker_link {
+    public:
+        ~render_worker_link() { close(); }
+
+        bool connect(const std::string &addr, int scene_id, const std::vector<double> &config, int threads) {
+            fd = net::connect_to(addr, 30.0);
+            if (fd < 0) {
+                return false;
+            }
+
+            uint32_t type;
+            std::string payload;
+            if (!net::send_msg(fd, net::HELLO, hello_payload(scene_id, config, threads))
+                || !net::recv_msg(fd, type, payload) || type != net::ACCEPT) {
+                std::cerr << "\nCoordinator at " << addr << " did not accept this worker" << std::flush;
+                close();
+                return false;
+            }
+
+            return true;
+        }
+
+        // 1 with a message, 0 when nothing arrived within timeout_ms, -1 once the link is gone
+        int poll_msg(uint32_t &type, std::string &payload, int timeout_ms) {
+            pollfd p{fd, POLLIN, 0};
+            int n = ::poll(&p, 1, timeout_ms);
+            if (n == 0) {
+                return 0;
+            }
+            if (n < 0) {
+                return errno == EINTR ? 0 : -1;
+            }
+
+            return net::recv_msg(fd, type, payload) ? 1 : -1;
+        }
+
+        bool send(uint32_t type, const std::string &payload) {
+            return net::send_msg(fd, type, payload);
+        }
+
+        void close() {
+            if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+
+    private:
+        int fd = -1;
+};
+
+#endif
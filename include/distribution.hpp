@@ -0,0 +1,106 @@
+#ifndef DISTRIBUTION_HPP
+#define DISTRIBUTION_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/*
+    Discrete distribution over a list of non-negative weights, sampled by inverting its cdf
+*/
+class distribution_1d {
+    public:
+        distribution_1d() {}
+
+        distribution_1d(const std::vector<double> &weights) {
+            cdf.reserve(weights.size());
+            for (double w : weights) {
+                add(w);
+            }
+        }
+
+        void add(double weight) {
+            total += std::fmax(0.0, weight);
+            cdf.push_back(total);
+        }
+
+        size_t size() const { return cdf.size(); }
+        double sum() const { return total; }
+
+        double pmf(size_t i) const {
+            if (total <= 0) return 0;
+            double prev = i > 0 ? cdf[i - 1] : 0.0;
+            return (cdf[i] - prev) / total;
+        }
+
+        // u in [0, 1)
+        size_t sample(double u) const {
+            auto it = std::upper_bound(cdf.begin(), cdf.end(), u * total);
+            size_t i = it - cdf.begin();
+            return i < cdf.size() ? i : cdf.size() - 1;
+        }
+
+        /*
+            Treats the weights as a piecewise constant function over [0, 1) and samples a point
+            from it. pdf is the density of that point, i the bucket it fell in
+        */
+        double sample_continuous(double u, double &pdf, size_t &i) const {
+            i = sample(u);
+            double prev = i > 0 ? cdf[i - 1] : 0.0;
+            double width = cdf[i] - prev;
+            double du = width > 0 ? (u * total - prev) / width : 0.0;
+
+            pdf = density(i);
+            return (i + std::clamp(du, 0.0, 1.0)) / cdf.size();
+        }
+
+        // density of the piecewise constant function over [0, 1) in bucket i
+        double density(size_t i) const {
+            return pmf(i) * cdf.size();
+        }
+
+    private:
+        std::vector<double> cdf;
+        double total = 0;
+};
+
+/*
+    Piecewise constant distribution over [0, 1)^2 given a row major grid of weights, sampled as
+    a marginal over rows followed by the conditional distribution of the chosen row
+*/
+class distribution_2d {
+    public:
+        distribution_2d() {}
+
+        distribution_2d(const std::vector<double> &weights, int width, int height) {
+            rows.reserve(height);
+            for (int j = 0; j < height; j++) {
+                rows.emplace_back(std::vector<double>(weights.begin() + size_t(j) * width,
+                                                      weights.begin() + size_t(j + 1) * width));
+                marginal.add(rows.back().sum());
+            }
+        }
+
+        double sum() const { return marginal.sum(); }
+
+        // returns (x, y) in [0, 1)^2 and its density
+        void sample(double u0, double u1, double &x, double &y, double &pdf) const {
+            double pdf_y, pdf_x;
+            size_t j, i;
+            y = marginal.sample_continuous(u1, pdf_y, j);
+            x = rows[j].sample_continuous(u0, pdf_x, i);
+            pdf = pdf_x * pdf_y;
+        }
+
+        double pdf(double x, double y) const {
+            size_t j = std::min(size_t(std::fmax(y, 0.0) * rows.size()), rows.size() - 1);
+            size_t i = std::min(size_t(std::fmax(x, 0.0) * rows[j].size()), rows[j].size() - 1);
+            return marginal.density(j) * rows[j].density(i);
+        }
+
+    private:
+        std::vector<distribution_1d> rows;
+        distribution_1d marginal;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef ENVIRONMENT_HPP
+#define ENVIRONMENT_HPP
+
+#include "color.hpp"
+#include "distribution.hpp"
+
+/*
+    Light from an hdr lat-long background. Directions are sampled in proportion to texel
+    luminance, using the same (u, v) mapping as get_spherical_uv
+*/
+class env_light {
+    public:
+        env_light(shared_ptr<image_hdr_tex> tex) : tex(tex) {
+            int w = tex->img_width();
+            int h = tex->img_height();
+
+            std::vector<double> weights(size_t(w) * h);
+            for (int j = 0; j < h; j++) {
+                // rows near the poles cover less of the sphere
+                double sin_theta = std::sin(pi_col * (j + 0.5) / h);
+                for (int i = 0; i < w; i++) {
+                    weights[size_t(j) * w + i] = luminance(tex->pixel(i, j)) * sin_theta;
+                }
+            }
+
+            dist = distribution_2d(weights, w, h);
+        }
+
+        bool valid() const { return dist.sum() > 0; }
+
+        color value(const vec3 &dir) const {
+            auto unit_dir = unit_vector(dir);
+            double u, v; get_spherical_uv(unit_dir, u, v);
+            return tex->value(u, v, unit_dir);
+        }
+
+        vec3 random() const {
+            double x, y, pdf;
+            dist.sample(random_double(), random_double(), x, y, pdf);
+
+            // image rows run from v = 1 at the top, theta = v * pi and phi = u * 2pi - pi
+            double theta = (1 - y) * pi_col;
+            double phi = x * 2 * pi_col - pi_col;
+            double sin_theta = std::sin(theta);
+
+            return vec3(sin_theta * std::cos(phi), -std::cos(theta), -sin_theta * std::sin(phi));
+        }
+
+        double pdf_value(const vec3 &dir) const {
+            auto unit_dir = unit_vector(dir);
+            double sin_theta = std::sqrt(std::fmax(0.0, 1 - unit_dir.y() * unit_dir.y()));
+            if (sin_theta <= 0) {
+                return 0;
+            }
+
+            double u, v; get_spherical_uv(unit_dir, u, v);
+            return dist.pdf(u, 1 - v) / (2 * pi_col * pi_col * sin_theta);
+        }
+
+    private:
+        shared_ptr<image_hdr_tex> tex;
+        distribution_2d dist;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef FRAMEBUFFER_HPP
+#define FRAMEBUFFER_HPP
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "color.hpp"
+
+/*
+    Samples one pixel took during one pass, summed in double before they are folded into the
+    framebuffer's float sums
+*/
+struct sample_sum {
+    color sum = color(0, 0, 0);
+    double lum_sum = 0;
+    double lum_sqrd = 0;
+    int n = 0;
+
+    void add(const color &col) {
+        double l = luminance(col);
+        sum += col;
+        lum_sum += l;
+        lum_sqrd += l * l;
+        n++;
+    }
+};
+
+/*
+    Accumulation buffer of a render: summed radiance as contiguous float rgb, the number of
+    samples behind every pixel, and luminance moments for noise estimates. Each pixel is only
+    ever written by the thread rendering its tile
+*/
+class framebuffer {
+    public:
+        framebuffer() {}
+
+        framebuffer(int width, int height) : w(width), h(height) {
+            size_t pixels = size_t(w) * h;
+            rgb.assign(3 * pixels, 0.0f);
+            lum.assign(2 * pixels, 0.0f);
+            counts.assign(pixels, 0);
+        }
+
+        int width() const { return w; }
+        int height() const { return h; }
+        size_t size() const { return counts.size(); }
+
+        void add(size_t k, const sample_sum &s) {
+            rgb[3 * k] += float(s.sum.x());
+            rgb[3 * k + 1] += float(s.sum.y());
+            rgb[3 * k + 2] += float(s.sum.z());
+            lum[2 * k] += float(s.lum_sum);
+            lum[2 * k + 1] += float(s.lum_sqrd);
+            counts[k] += s.n;
+        }
+
+        int samples(size_t k) const { return counts[k]; }
+
+        color mean(size_t k) const {
+            if (counts[k] <= 0) {
+                return color(0, 0, 0);
+            }
+
+            return color(rgb[3 * k], rgb[3 * k + 1], rgb[3 * k + 2]) / counts[k];
+        }
+
+        /*
+            Standard error of the mean over the mean. Dark pixels are measured against a floor
+            so noise nobody can see does not soak up the budget
+        */
+        double rel_error(size_t k) const {
+            int n = counts[k];
+            if (n < 2) return inf;
+
+            double mean = double(lum[2 * k]) / n;
+            double var = std::fmax(0.0, (double(lum[2 * k + 1]) - double(lum[2 * k]) * mean) / (n - 1));
+            return std::sqrt(var / n) / std::fmax(mean, 0.001);
+        }
+
+        // raw dump of the buffer for checkpoints
+        void save(std::ostream &out) const {
+            out.write(reinterpret_cast<const char*>(&w), sizeof(w));
+            out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            out.write(reinterpret_cast<const char*>(rgb.data()), rgb.size() * sizeof(float));
+            out.write(reinterpret_cast<const char*>(lum.data()), lum.size() * sizeof(float));
+            out.write(reinterpret_cast<const char*>(counts.data()), counts.size() * sizeof(int));
+        }
+
+        bool load(std::istream &in) {
+            int width = 0, height = 0;
+            in.read(reinterpret_cast<char*>(&width), sizeof(width));
+            in.read(reinterpret_cast<char*>(&height), sizeof(height));
+            if (!in || width <= 0 || height <= 0) {
+                return false;
+            }
+
+            *this = framebuffer(width, height);
+            in.read(reinterpret_cast<char*>(rgb.data()), rgb.size() * sizeof(float));
+            in.read(reinterpret_cast<char*>(lum.data()), lum.size() * sizeof(float));
+            in.read(reinterpret_cast<char*>(counts.data()), counts.size() * sizeof(int));
+            return bool(in);
+        }
+
+    private:
+        int w = 0, h = 0;
+        std::vector<float> rgb;     // summed radiance, 3 per pixel
+        std::vector<float> lum;     // summed luminance and squared luminance, 2 per pixel
+        std::vector<int> counts;    // samples per pixel
+};
+
+#endif
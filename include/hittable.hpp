@@ -1,14 +1,23 @@
 #ifndef HITTABLE_HPP
 #define HITTABLE_HPP
 
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <memory>
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "vec3.hpp"
 #include "ray.hpp"
 #include "interval.hpp"
 #include "color.hpp"
 #include "axis-bounding-box.hpp"
+#include "distribution.hpp"
 
 using std::make_shared;
 using std::shared_ptr;
@@ -20,13 +29,53 @@ inline double degrees_to_rad(double x) {
 
 const double h_inf = std::numeric_limits<double>::infinity();
 
-class material;
+class hittable;
+
+// index of a material in the scene's material table (scene_materials()), 0 for the placeholder
+using material_id = uint32_t;
+
+/*
+    Where the space a primitive was hit in sits in the world: turned about the y axis by the
+    angle whose cosine and sine are c and s, then moved by offset
+*/
+struct placement {
+    double c = 1, s = 0;
+    vec3 offset = vec3(0, 0, 0);
+
+    vec3 rotate(const vec3 &v) const {
+        return vec3((c * v.x()) + (s * v.z()), v.y(), (-s * v.x()) + (c * v.z()));
+    }
+
+    vec3 unrotate(const vec3 &v) const {
+        return vec3((c * v.x()) - (s * v.z()), v.y(), (s * v.x()) + (c * v.z()));
+    }
+
+    // r seen from the primitive's own space
+    ray to_local(const ray &r) const {
+        return ray(unrotate(r.origin() - offset), unrotate(r.direction()), r.time());
+    }
+
+    // placed inside a space that sits at d in the next one out
+    void move(const vec3 &d) { offset += d; }
+
+    // placed inside a space turned by (c2, s2) in the next one out
+    void turn(double c2, double s2) {
+        offset = vec3((c2 * offset.x()) + (s2 * offset.z()), offset.y(), (-s2 * offset.x()) + (c2 * offset.z()));
+        double nc = c2 * c - s2 * s;
+        s = s2 * c + c2 * s;
+        c = nc;
+    }
+};
 
-class hit_record {
+/*
+    Surface at a hit, everything shading needs: where it is, the normal facing against the ray,
+    the material and the surface coordinates
+*/
+class surface_record {
     public:
         vec3 p;
         vec3 norm;
-        shared_ptr<material> mat;
+        material_id mat = 0;
         double t, u, v;
         bool facing;
 
@@ -36,23 +85,264 @@ class hit_record {
         }
 };
 
+/*
+    A hit while the closest one is searched for. Primitives record only t, themselves and
+    their parametric coordinates (u, v); translate and rotate_y stack their placement onto it
+    on the way out. finalize() works out the surface once, for the hit that won
+*/
+class hit_record {
+    public:
+        double t, u, v;
+        const hittable *obj = nullptr;  // primitive that was hit
+        placement place;                // of obj's space in the world
+
+        // a hit of prim at t along a ray in prim's own space
+        void set_hit(double at, const hittable *prim) {
+            t = at;
+            obj = prim;
+            place = placement();
+        }
+
+        // the surface of the hit along the world space ray r
+        surface_record finalize(const ray &r) const;
+};
+
+/*
+    Up to max_size rays traced through the scene together, picked out by bit masks. Every ray
+    keeps its own search interval, hit record and sample stream. Origins, reciprocal
+    directions and intervals are also kept one array per component, so a box is tested against
+    several rays at once in SIMD lanes (hits_box). When the directions share their sign on
+    every axis the packet is coherent, and the bounds of its origins and inverse directions can
+    rule a box out for all of its rays with one interval arithmetic test (misses)
+*/
+struct ray_packet {
+    static constexpr int max_size = 16;
+
+    int size = 0;
+    ray rays[max_size];
+    hit_record *recs[max_size] = {};
+    sample_stream *streams[max_size] = {};  // stochastic hits draw from these, null for the thread's own
+
+    // lanes, unused ones are left with an empty interval
+    alignas(32) double org[3][max_size];
+    alignas(32) double rcp[3][max_size];
+    alignas(32) double t_min[max_size];
+    alignas(32) double t_max[max_size];
+
+    bool coherent = false;
+    double org_lo[3], org_hi[3];
+    double rcp_lo[3], rcp_hi[3];
+
+    uint32_t all() const { return (1u << size) - 1; }
+
+    void set(int k, const ray &r, interval inter, hit_record *rec, sample_stream *stream) {
+        rays[k] = r;
+        t_min[k] = inter.min;
+        t_max[k] = inter.max;
+        recs[k] = rec;
+        streams[k] = stream;
+    }
+
+    // lanes and bounds of the packet, call once its rays are set
+    void prepare() {
+        for (int k = 0; k < max_size; k++) {
+            for (int a = 0; a < 3; a++) {
+                org[a][k] = k < size ? double(rays[k].origin()[a]) : 0.0;
+                rcp[a][k] = k < size ? 1.0 / rays[k].direction()[a] : 0.0;
+            }
+
+            if (k >= size) {
+                t_min[k] = std::numeric_limits<double>::infinity();
+                t_max[k] = -std::numeric_limits<double>::infinity();
+            }
+        }
+
+        coherent = size > 0;
+
+        for (int a = 0; a < 3 && coherent; a++) {
+            org_lo[a] = org_hi[a] = rays[0].origin()[a];
+            rcp_lo[a] = rcp_hi[a] = rcp[a][0];
+
+            for (int k = 0; k < size; k++) {
+                double o = org[a][k];
+                double r = rcp[a][k];
+
+                if (!std::isfinite(r) || (r > 0) != (rcp_lo[a] > 0)) {
+                    coherent = false;
+                    break;
+                }
+
+                org_lo[a] = std::min(org_lo[a], o);
+                org_hi[a] = std::max(org_hi[a], o);
+                rcp_lo[a] = std::min(rcp_lo[a], r);
+                rcp_hi[a] = std::max(rcp_hi[a], r);
+            }
+        }
+    }
+
+    /*
+        True when no ray of mask can hit box. Bounds the slab distances every ray of the packet
+        computes in axis_bound_box::hit from below (entry) and above (exit); rounding is
+        monotonic, so the bounds hold for the rounded per ray values too
+    */
+    bool misses(const axis_bound_box &box, uint32_t mask) const {
+        if (!coherent) {
+            return false;
+        }
+
+        double near_lo = std::numeric_limits<double>::infinity();
+        double far_hi = -std::numeric_limits<double>::infinity();
+        for (int k = 0; k < size; k++) {
+            if (mask >> k & 1) {
+                near_lo = std::min(near_lo, t_min[k]);
+                far_hi = std::max(far_hi, t_max[k]);
+            }
+        }
+
+        for (int a = 0; a < 3; a++) {
+            const interval &ax = box.axis_interval(a);
+            bool pos = rcp_lo[a] > 0;
+            double entry = pos ? ax.min : ax.max;
+            double exit = pos ? ax.max : ax.min;
+
+            double e0 = entry - org_hi[a], e1 = entry - org_lo[a];
+            double x0 = exit - org_hi[a], x1 = exit - org_lo[a];
+
+            near_lo = std::max(near_lo, std::min({e0 * rcp_lo[a], e0 * rcp_hi[a], e1 * rcp_lo[a], e1 * rcp_hi[a]}));
+            far_hi = std::min(far_hi, std::max({x0 * rcp_lo[a], x0 * rcp_hi[a], x1 * rcp_lo[a], x1 * rcp_hi[a]}));
+        }
+
+        return far_hi <= near_lo;
+    }
+
+    /*
+        The rays of mask that pass through box, as bits. Does axis_bound_box::hit for four
+        rays at a time with AVX or two with SSE2, one by one otherwise. The min and max
+        operands are ordered so that a NaN slab distance (a ray in the plane of a slab) is
+        skipped the same way the scalar comparisons skip it, so the bits match the scalar test
+        exactly
+    */
+    uint32_t hits_box(const axis_bound_box &box, uint32_t mask) const {
+        uint32_t inside = 0;
+
+#if defined(__AVX__)
+        for (int k = 0; k < size; k += 4) {
+            __m256d lo = _mm256_load_pd(t_min + k);
+            __m256d hi = _mm256_load_pd(t_max + k);
+
+            for (int a = 0; a < 3; a++) {
+                const interval &ax = box.axis_interval(a);
+                __m256d o = _mm256_load_pd(org[a] + k);
+                __m256d r = _mm256_load_pd(rcp[a] + k);
+                __m256d t0 = _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(ax.min), o), r);
+                __m256d t1 = _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(ax.max), o), r);
+
+                lo = _mm256_max_pd(_mm256_min_pd(t0, t1), lo);
+                hi = _mm256_min_pd(_mm256_max_pd(t1, t0), hi);
+            }
+
+            inside |= uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(hi, lo, _CMP_GT_OQ))) << k;
+        }
+#elif defined(__SSE2__)
+        for (int k = 0; k < size; k += 2) {
+            __m128d lo = _mm_load_pd(t_min + k);
+            __m128d hi = _mm_load_pd(t_max + k);
+
+            for (int a = 0; a < 3; a++) {
+                const interval &ax = box.axis_interval(a);
+                __m128d o = _mm_load_pd(org[a] + k);
+                __m128d r = _mm_load_pd(rcp[a] + k);
+                __m128d t0 = _mm_mul_pd(_mm_sub_pd(_mm_set1_pd(ax.min), o), r);
+                __m128d t1 = _mm_mul_pd(_mm_sub_pd(_mm_set1_pd(ax.max), o), r);
+
+                lo = _mm_max_pd(_mm_min_pd(t0, t1), lo);
+                hi = _mm_min_pd(_mm_max_pd(t1, t0), hi);
+            }
+
+            inside |= uint32_t(_mm_movemask_pd(_mm_cmpgt_pd(hi, lo))) << k;
+        }
+#else
+        for (int k = 0; k < size; k++) {
+            if (box.hit(rays[k], interval(t_min[k], t_max[k]))) {
+                inside |= 1u << k;
+            }
+        }
+#endif
+
+        return inside & mask;
+    }
+};
+
 class hittable {
     public:
         virtual ~hittable() = default;
 
         virtual bool hit(const ray &r, interval inter, hit_record &rec) const = 0;
 
+        /*
+            Closest hits for the rays of pk picked by mask. A ray that hits inside its interval
+            records the hit, shrinks its interval to it and sets its bit in hits, the same as
+            hit() would. By default every ray is traced on its own
+        */
+        virtual void hit_packet(ray_packet &pk, uint32_t mask, uint32_t &hits) const {
+            for (int k = 0; k < pk.size; k++) {
+                if (mask >> k & 1) {
+                    hit_one(pk, k, hits);
+                }
+            }
+        }
+
+        // ray k of pk traced alone, with its own sample stream
+        void hit_one(ray_packet &pk, int k, uint32_t &hits) const {
+            sampler_scope scope;
+            if (pk.streams[k]) {
+                scope.use(*pk.streams[k]);
+            }
+
+            if (hit(pk.rays[k], interval(pk.t_min[k], pk.t_max[k]), *pk.recs[k])) {
+                hits |= 1u << k;
+                pk.t_max[k] = pk.recs[k]->t;
+            }
+        }
+
         virtual axis_bound_box bounding_box() const = 0;
 
+        // fills in the surface of a hit this object recorded, with r in the object's own space
+        virtual void surface(const ray &r, surface_record &rec) const {}
+
         virtual double pdf_value(const vec3 &orig, const vec3 &dir) const {
             return 0.0;
         }
 
+        // direction from orig toward a sampled point of the object, zero when no point could be picked
         virtual vec3 random(const vec3 &orig) const {
-            return vec3(1, 0, 0);
+            return vec3(0, 0, 0);
+        }
+
+        // relative emitted power, used to pick between several lights
+        virtual double power() const {
+            return 1.0;
+        }
+
+        // flat emitters report the normal of their emitting side, others emit in every direction
+        virtual bool emit_normal(vec3 &n) const {
+            return false;
         }
 };
 
+inline surface_record hit_record::finalize(const ray &r) const {
+    surface_record rec;
+    rec.t = t;
+    rec.u = u;
+    rec.v = v;
+
+    obj->surface(place.to_local(r), rec);
+
+    rec.p = place.rotate(rec.p) + place.offset;
+    rec.norm = place.rotate(rec.norm);
+    return rec;
+}
+
 class translate : public hittable {
     public:
         translate(shared_ptr<hittable> obj, const vec3 &offset) : obj(obj), offset(offset) {
@@ -65,12 +355,24 @@ class translate : public hittable {
                 return false;
             }
 
-            rec.p += offset;
+            rec.place.move(offset);
             return true;
         }
 
         axis_bound_box bounding_box() const override { return bound_box; }
 
+        double pdf_value(const vec3 &orig, const vec3 &dir) const override {
+            return obj->pdf_value(orig - offset, dir);
+        }
+
+        vec3 random(const vec3 &orig) const override {
+            return obj->random(orig - offset);
+        }
+
+        double power() const override { return obj->power(); }
+
+        bool emit_normal(vec3 &n) const override { return obj->emit_normal(n); }
+
     private:
         shared_ptr<hittable> obj;
         vec3 offset;
@@ -110,45 +412,55 @@ class rotate_y : public hittable {
         }
 
         bool hit(const ray &r, interval inter, hit_record &rec) const override {
-            auto orig = vec3(
-                (c_th * r.origin().x()) - (s_th * r.origin().z()),
-                r.origin().y(),
-                (s_th * r.origin().x()) + (c_th * r.origin().z())
-            );
-
-            auto dir = vec3(
-                (c_th * r.direction().x()) - (s_th * r.direction().z()),
-                r.direction().y(),
-                (s_th * r.direction().x()) + (c_th * r.direction().z())
-            );
-
-            ray rotated(orig, dir, r.time());
+            ray rotated(to_object(r.origin()), to_object(r.direction()), r.time());
 
             if (!obj->hit(rotated, inter, rec)) {
                 return false;
             }
 
-            rec.p = vec3(
-                (c_th * rec.p.x()) + (s_th * rec.p.z()),
-                rec.p.y(),
-                (-s_th * rec.p.x()) + (c_th * rec.p.z())
-            );
+            rec.place.turn(c_th, s_th);
+            return true;
+        }
+
+        axis_bound_box bounding_box() const override { return bound_box; }
+
+        double pdf_value(const vec3 &orig, const vec3 &dir) const override {
+            return obj->pdf_value(to_object(orig), to_object(dir));
+        }
 
-            rec.norm = vec3(
-                (c_th * rec.norm.x()) + (s_th * rec.norm.z()),
-                rec.norm.y(),
-                (-s_th * rec.norm.x()) + (c_th * rec.norm.z())
+        vec3 random(const vec3 &orig) const override {
+            auto dir = obj->random(to_object(orig));
+            return vec3(
+                (c_th * dir.x()) + (s_th * dir.z()),
+                dir.y(),
+                (-s_th * dir.x()) + (c_th * dir.z())
             );
+        }
+
+        double power() const override { return obj->power(); }
 
+        bool emit_normal(vec3 &n) const override {
+            if (!obj->emit_normal(n)) {
+                return false;
+            }
+
+            n = vec3((c_th * n.x()) + (s_th * n.z()), n.y(), (-s_th * n.x()) + (c_th * n.z()));
             return true;
         }
 
-        axis_bound_box bounding_box() const override { return bound_box; }
-
     private:
         shared_ptr<hittable> obj;
         double s_th, c_th;
         axis_bound_box bound_box;
+
+        // world space to the un-rotated space of obj
+        vec3 to_object(const vec3 &p) const {
+            return vec3(
+                (c_th * p.x()) - (s_th * p.z()),
+                p.y(),
+                (s_th * p.x()) + (c_th * p.z())
+            );
+        }
 };
 
 class hittable_list : public hittable {
@@ -163,33 +475,70 @@ class hittable_list : public hittable {
             }
         }
 
-        void remove_objs() { objs.clear(); }
+        void remove_objs() {
+            objs.clear();
+            light_dist = distribution_1d();
+        }
 
         void add(shared_ptr<hittable> obj) {
             objs.push_back(obj);
             bound_box = axis_bound_box(bound_box, obj->bounding_box());
+            light_dist.add(obj->power());
         }
 
+        // objects only write rec when they hit closer than closest_hit, so they all share it
         bool hit(const ray &r, interval inter, hit_record &rec) const override {
-            hit_record temp;
             bool hits = false;
             auto closest_hit = inter.max;
 
             for (const auto &obj : objs) {
-                if (obj->hit(r, interval(inter.min, closest_hit), temp)) {
+                if (obj->hit(r, interval(inter.min, closest_hit), rec)) {
                     hits = true;
-                    closest_hit = temp.t;
-                    rec = temp;
+                    closest_hit = rec.t;
                 }
             }
 
             return hits;
         }
 
+        // like hit(), every object takes the whole packet, whose intervals shrink to the closest hits so far
+        void hit_packet(ray_packet &pk, uint32_t mask, uint32_t &hits) const override {
+            for (const auto &obj : objs) {
+                obj->hit_packet(pk, mask, hits);
+            }
+        }
+
         axis_bound_box bounding_box() const override { return bound_box; }
 
+        /*
+            As a light collection each object is picked in proportion to its power, so the
+            direction pdf is the power-weighted sum of every object's own pdf
+        */
+        double pdf_value(const vec3 &orig, const vec3 &dir) const override {
+            double sum = 0.0;
+            for (size_t i = 0; i < objs.size(); i++) {
+                double pmf = light_dist.pmf(i);
+                if (pmf > 0) {
+                    sum += pmf * objs[i]->pdf_value(orig, dir);
+                }
+            }
+
+            return sum;
+        }
+
+        vec3 random(const vec3 &orig) const override {
+            if (light_dist.sum() <= 0) {
+                return vec3(0, 0, 0);
+            }
+
+            return objs[light_dist.sample(random_double())]->random(orig);
+        }
+
+        double power() const override { return light_dist.sum(); }
+
     private:
         axis_bound_box bound_box;
+        distribution_1d light_dist;   // objects weighted by power()
 };  
 
 #endif
\ No newline at end of file
@@ -0,0 +1,582 @@
+#ifndef IMAGE_IO_HPP
+#define IMAGE_IO_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framebuffer.hpp"
+
+/*
+    Output formats
+        PPM_ASCII: P3 ppm, 8 bit
+        PPM:       binary P6 ppm, 8 bit
+        PNG:       8 bit rgb png with stored (uncompressed) deflate blocks
+        PFM:       linear 32 bit float
+        EXR:       linear half float, uncompressed scanlines
+    AUTO picks the format from the file extension
+*/
+enum class image_format {
+    AUTO,
+    PPM_ASCII,
+    PPM,
+    PNG,
+    PFM,
+    EXR
+};
+
+inline image_format format_from_name(const std::string &name) {
+    if (name == "p3" || name == "ppm-ascii") return image_format::PPM_ASCII;
+    if (name == "ppm" || name == "p6") return image_format::PPM;
+    if (name == "png") return image_format::PNG;
+    if (name == "pfm") return image_format::PFM;
+    if (name == "exr") return image_format::EXR;
+    return image_format::AUTO;
+}
+
+inline image_format format_from_path(const std::string &path) {
+    auto dot = path.find_last_of('.');
+    if (dot == std::string::npos) {
+        return image_format::PPM;
+    }
+
+    image_format f = format_from_name(path.substr(dot + 1));
+    return f == image_format::AUTO ? image_format::PPM : f;
+}
+
+inline image_format resolve_format(const std::string &path, image_format format) {
+    return format == image_format::AUTO ? format_from_path(path) : format;
+}
+
+/*
+    8 bit display image, rgb interleaved, rows from the top
+*/
+struct image_8bit {
+    int width = 0, height = 0;
+    std::vector<unsigned char> data;
+};
+
+/*
+    Linear float image, rgb interleaved, rows from the top
+*/
+struct image_float {
+    int width = 0, height = 0;
+    std::vector<float> data;
+};
+
+/*
+    Quantize stage. Turns the pixel means of a framebuffer, times scale, into display values
+    with the same tone mapping write_color used
+*/
+inline image_8bit quantize(const framebuffer &fb, double scale, bool is_hdr, double gamma) {
+    image_8bit img;
+    img.width = fb.width();
+    img.height = fb.height();
+    img.data.resize(3 * fb.size());
+
+    for (size_t k = 0; k < fb.size(); k++) {
+        color out = to_display(fb.mean(k) * scale, is_hdr, gamma);
+        img.data[3 * k] = static_cast<unsigned char>(255.999 * out.x());
+        img.data[3 * k + 1] = static_cast<unsigned char>(255.999 * out.y());
+        img.data[3 * k + 2] = static_cast<unsigned char>(255.999 * out.z());
+    }
+
+    return img;
+}
+
+// pixel means times scale, no tone mapping, for the hdr formats
+inline image_float linear_image(const framebuffer &fb, double scale) {
+    image_float img;
+    img.width = fb.width();
+    img.height = fb.height();
+    img.data.resize(3 * fb.size());
+
+    for (size_t k = 0; k < fb.size(); k++) {
+        color c = fb.mean(k) * scale;
+        img.data[3 * k] = float(c.x());
+        img.data[3 * k + 1] = float(c.y());
+        img.data[3 * k + 2] = float(c.z());
+    }
+
+    return img;
+}
+
+/*
+    Writes bytes next to path and renames them over it, so readers never see half an image.
+    A write that fails (full disk, I/O error) leaves whatever was at path in place
+*/
+inline bool write_file(const std::string &path, const std::string &bytes) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary);
+        if (!file) {
+            std::cerr << "\nCan't write " << path << std::flush;
+            return false;
+        }
+        file.write(bytes.data(), bytes.size());
+        file.close();
+
+        if (!file) {
+            std::remove(tmp.c_str());
+            std::cerr << "\nCan't write " << path << std::flush;
+            return false;
+        }
+    }
+
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+inline void put_u32_be(std::string &out, uint32_t v) {
+    out += char(v >> 24);
+    out += char(v >> 16);
+    out += char(v >> 8);
+    out += char(v);
+}
+
+inline void put_u32_le(std::string &out, uint32_t v) {
+    out += char(v);
+    out += char(v >> 8);
+    out += char(v >> 16);
+    out += char(v >> 24);
+}
+
+inline void put_f32_le(std::string &out, float f) {
+    uint32_t v;
+    std::memcpy(&v, &f, 4);
+    put_u32_le(out, v);
+}
+
+inline std::string ppm_header(bool ascii, int width, int height) {
+    return std::string(ascii ? "P3\n" : "P6\n") + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+}
+
+inline void append_ppm_ascii_rows(std::string &out, const image_8bit &img) {
+    out.reserve(out.size() + 12 * img.data.size() / 3);
+
+    char buf[16];
+    for (size_t k = 0; k < img.data.size(); k += 3) {
+        int len = std::snprintf(buf, sizeof(buf), "%d %d %d\n", img.data[k], img.data[k + 1], img.data[k + 2]);
+        out.append(buf, len);
+    }
+}
+
+inline std::string encode_ppm_ascii(const image_8bit &img) {
+    std::string out = ppm_header(true, img.width, img.height);
+    append_ppm_ascii_rows(out, img);
+    return out;
+}
+
+inline std::string encode_ppm(const image_8bit &img) {
+    std::string out = ppm_header(false, img.width, img.height);
+    out.append(reinterpret_cast<const char*>(img.data.data()), img.data.size());
+    return out;
+}
+
+inline std::string pfm_header(int width, int height) {
+    return "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+}
+
+// little endian pfm, rows from the bottom
+inline std::string encode_pfm(const image_float &img) {
+    std::string out = pfm_header(img.width, img.height);
+    out.reserve(out.size() + 4 * img.data.size());
+
+    for (int j = img.height - 1; j >= 0; j--) {
+        for (size_t k = 3 * size_t(j) * img.width; k < 3 * size_t(j + 1) * img.width; k++) {
+            put_f32_le(out, img.data[k]);
+        }
+    }
+
+    return out;
+}
+
+inline uint32_t crc32(const unsigned char *data, size_t len, uint32_t crc = 0) {
+    static uint32_t table[256];
+    static bool init = [] {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        return true;
+    }();
+    (void)init;
+
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// adler is the checksum of the data before, 1 to start
+inline uint32_t adler32(const unsigned char *data, size_t len, uint32_t adler = 1) {
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    for (size_t i = 0; i < len; i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+inline void put_png_chunk(std::string &out, const char *type, const std::string &data) {
+    put_u32_be(out, uint32_t(data.size()));
+
+    std::string body = std::string(type, 4) + data;
+    out += body;
+    put_u32_be(out, crc32(reinterpret_cast<const unsigned char*>(body.data()), body.size()));
+}
+
+// png signature and IHDR of an 8 bit rgb image
+inline std::string png_header(int width, int height) {
+    std::string out("\x89PNG\r\n\x1a\n", 8);
+
+    std::string ihdr;
+    put_u32_be(ihdr, uint32_t(width));
+    put_u32_be(ihdr, uint32_t(height));
+    ihdr += char(8);    // bit depth
+    ihdr += char(2);    // truecolor
+    ihdr += char(0);    // deflate
+    ihdr += char(0);    // adaptive filtering, every line uses filter 0
+    ihdr += char(0);    // no interlace
+    put_png_chunk(out, "IHDR", ihdr);
+
+    return out;
+}
+
+/*
+    IDAT chunk holding the next rows of a png. The zlib stream only holds stored deflate blocks,
+    which keeps the writer free of dependencies at the cost of compression. The first call
+    opens the stream, the last one closes it with the running adler checksum
+*/
+inline std::string png_idat(const image_8bit &rows, uint32_t &adler, bool first, bool last) {
+    size_t row = 3 * size_t(rows.width);
+    std::string raw;
+    raw.reserve((row + 1) * rows.height);
+    for (int j = 0; j < rows.height; j++) {
+        raw += char(0);
+        raw.append(reinterpret_cast<const char*>(rows.data.data()) + j * row, row);
+    }
+
+    std::string z;
+    if (first) {
+        z += char(0x78);
+        z += char(0x01);
+        adler = 1;
+    }
+
+    size_t pos = 0;
+    do {
+        size_t len = std::min<size_t>(65535, raw.size() - pos);
+        bool final_block = last && pos + len >= raw.size();
+
+        z += char(final_block ? 1 : 0);
+        z += char(len & 0xff);
+        z += char(len >> 8);
+        z += char(~len & 0xff);
+        z += char((~len >> 8) & 0xff);
+        z.append(raw, pos, len);
+
+        pos += len;
+    } while (pos < raw.size());
+
+    adler = adler32(reinterpret_cast<const unsigned char*>(raw.data()), raw.size(), adler);
+    if (last) {
+        put_u32_be(z, adler);
+    }
+
+    std::string out;
+    put_png_chunk(out, "IDAT", z);
+    return out;
+}
+
+inline std::string png_end() {
+    std::string out;
+    put_png_chunk(out, "IEND", "");
+    return out;
+}
+
+inline std::string encode_png(const image_8bit &img) {
+    uint32_t adler;
+    return png_header(img.width, img.height) + png_idat(img, adler, true, true) + png_end();
+}
+
+// IEEE half from float, rounding to nearest even
+inline uint16_t float_to_half(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, 4);
+
+    uint32_t sign = (x >> 16) & 0x8000;
+    int exp = int((x >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = x & 0x7fffff;
+
+    if (((x >> 23) & 0xff) == 0xff) {
+        return uint16_t(sign | 0x7c00 | (mant ? 0x200 : 0));    // inf or nan
+    }
+    if (exp >= 31) {
+        return uint16_t(sign | 0x7c00);                          // overflow to inf
+    }
+    if (exp <= 0) {
+        if (exp < -10) {
+            return uint16_t(sign);                               // underflow to zero
+        }
+
+        // subnormal half
+        mant |= 0x800000;
+        int shift = 14 - exp;
+        uint32_t half = mant >> shift;
+        uint32_t rest = mant & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) half++;
+        return uint16_t(sign | half);
+    }
+
+    uint32_t half = sign | (uint32_t(exp) << 10) | (mant >> 13);
+    uint32_t rest = mant & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+    return uint16_t(half);
+}
+
+inline void put_exr_attr(std::string &out, const char *name, const char *type, const std::string &value) {
+    out += name;
+    out += char(0);
+    out += type;
+    out += char(0);
+    put_u32_le(out, uint32_t(value.size()));
+    out += value;
+}
+
+/*
+    Header and scanline offset table of an OpenEXR image with half float B, G, R channels and
+    no compression. Every scanline has the same size, so all offsets are known up front
+*/
+inline std::string exr_header(int width, int height) {
+    std::string out;
+    put_u32_le(out, 20000630);  // magic
+    put_u32_le(out, 2);         // version 2, single part scanline
+
+    // channels are listed in alphabetical order
+    std::string chlist;
+    for (const char *ch : {"B", "G", "R"}) {
+        chlist += ch;
+        chlist += char(0);
+        put_u32_le(chlist, 1);  // half
+        chlist += char(0);      // pLinear
+        chlist += std::string(3, '\0');
+        put_u32_le(chlist, 1);  // x sampling
+        put_u32_le(chlist, 1);  // y sampling
+    }
+    chlist += char(0);
+
+    std::string window;
+    put_u32_le(window, 0);
+    put_u32_le(window, 0);
+    put_u32_le(window, uint32_t(width - 1));
+    put_u32_le(window, uint32_t(height - 1));
+
+    std::string one, center;
+    put_f32_le(one, 1.0f);
+    put_f32_le(center, 0.0f);
+    put_f32_le(center, 0.0f);
+
+    put_exr_attr(out, "channels", "chlist", chlist);
+    put_exr_attr(out, "compression", "compression", std::string(1, '\0'));
+    put_exr_attr(out, "dataWindow", "box2i", window);
+    put_exr_attr(out, "displayWindow", "box2i", window);
+    put_exr_attr(out, "lineOrder", "lineOrder", std::string(1, '\0'));
+    put_exr_attr(out, "pixelAspectRatio", "float", one);
+    put_exr_attr(out, "screenWindowCenter", "v2f", center);
+    put_exr_attr(out, "screenWindowWidth", "float", one);
+    out += char(0);
+
+    // offset table, one entry per scanline
+    uint32_t line_bytes = uint32_t(width) * 3 * 2;
+    uint64_t offset = out.size() + 8 * size_t(height);
+    for (int j = 0; j < height; j++) {
+        put_u32_le(out, uint32_t(offset));
+        put_u32_le(out, uint32_t(offset >> 32));
+        offset += 8 + line_bytes;
+    }
+
+    return out;
+}
+
+// scanline blocks of rows, the first of them being image row y0
+inline void append_exr_lines(std::string &out, const image_float &rows, int y0) {
+    uint32_t line_bytes = uint32_t(rows.width) * 3 * 2;
+
+    for (int j = 0; j < rows.height; j++) {
+        put_u32_le(out, uint32_t(y0 + j));
+        put_u32_le(out, line_bytes);
+
+        for (int c : {2, 1, 0}) {
+            for (int i = 0; i < rows.width; i++) {
+                uint16_t h = float_to_half(rows.data[3 * (size_t(j) * rows.width + i) + c]);
+                out += char(h & 0xff);
+                out += char(h >> 8);
+            }
+        }
+    }
+}
+
+inline std::string encode_exr(const image_float &img) {
+    std::string out = exr_header(img.width, img.height);
+    append_exr_lines(out, img, 0);
+    return out;
+}
+
+/*
+    Writes fb to path in the given format. 8 bit formats are tone mapped like the display,
+    pfm and exr keep the linear values
+*/
+inline bool write_image(const std::string &path, image_format format, const framebuffer &fb,
+                        double scale, bool is_hdr, double gamma) {
+    switch (resolve_format(path, format)) {
+        case image_format::PPM_ASCII: return write_file(path, encode_ppm_ascii(quantize(fb, scale, is_hdr, gamma)));
+        case image_format::PNG: return write_file(path, encode_png(quantize(fb, scale, is_hdr, gamma)));
+        case image_format::PFM: return write_file(path, encode_pfm(linear_image(fb, scale)));
+        case image_format::EXR: return write_file(path, encode_exr(linear_image(fb, scale)));
+        default: return write_file(path, encode_ppm(quantize(fb, scale, is_hdr, gamma)));
+    }
+}
+
+inline bool write_ppm(const std::string &path, const image_8bit &img) {
+    return write_file(path, encode_ppm(img));
+}
+
+/*
+    Runs image encoding off the render thread. At most one job is in flight, a new job first
+    waits for the previous one, so a slow disk holds back the render instead of piling up
+    copies of the image
+*/
+class image_writer {
+    public:
+        ~image_writer() { wait(); }
+
+        void submit(std::function<void()> job) {
+            wait();
+            worker = std::thread(std::move(job));
+        }
+
+        void wait() {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+
+    private:
+        std::thread worker;
+};
+
+/*
+    Writes an image band by band, top to bottom, straight into its final file so a killed
+    render leaves the rows finished so far. Bands are framebuffers as wide as the image.
+    Only pfm, which stores rows bottom up, seeks: its file is sized up front and every band
+    lands at its own offset
+*/
+class image_stream {
+    public:
+        ~image_stream() { close(); }
+
+        bool open(const std::string &path, image_format f, int width, int height) {
+            close();
+
+            format = resolve_format(path, f);
+            w = width;
+            h = height;
+            next_row = 0;
+
+            file.open(path, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                std::cerr << "\nCan't write " << path << std::flush;
+                return false;
+            }
+
+            std::string head;
+            switch (format) {
+                case image_format::PPM_ASCII: head = ppm_header(true, w, h); break;
+                case image_format::PNG: head = png_header(w, h); break;
+                case image_format::PFM: head = pfm_header(w, h); break;
+                case image_format::EXR: head = exr_header(w, h); break;
+                default: head = ppm_header(false, w, h); break;
+            }
+            file.write(head.data(), head.size());
+            data_start = head.size();
+
+            if (format == image_format::PFM && h > 0) {
+                // size the file so bands can be placed anywhere in it
+                file.seekp(data_start + 12 * size_t(w) * h - 1);
+                file.put(0);
+            }
+
+            return true;
+        }
+
+        // next band of rows, scaled and tone mapped like write_image
+        void write(const framebuffer &band, double scale, bool is_hdr, double gamma) {
+            if (!file.is_open()) {
+                return;
+            }
+
+            bool last = next_row + band.height() >= h;
+            std::string out;
+
+            switch (format) {
+                case image_format::PPM_ASCII:
+                    append_ppm_ascii_rows(out, quantize(band, scale, is_hdr, gamma));
+                    break;
+                case image_format::PNG:
+                    out = png_idat(quantize(band, scale, is_hdr, gamma), adler, next_row == 0, last);
+                    if (last) out += png_end();
+                    break;
+                case image_format::PFM: {
+                    image_float rows = linear_image(band, scale);
+                    for (int j = 0; j < rows.height; j++) {
+                        std::string line;
+                        for (int k = 0; k < 3 * w; k++) {
+                            put_f32_le(line, rows.data[3 * size_t(j) * w + k]);
+                        }
+                        file.seekp(data_start + 12 * size_t(w) * (h - 1 - (next_row + j)));
+                        file.write(line.data(), line.size());
+                    }
+                    break;
+                }
+                case image_format::EXR:
+                    append_exr_lines(out, linear_image(band, scale), next_row);
+                    break;
+                default: {
+                    image_8bit rows = quantize(band, scale, is_hdr, gamma);
+                    out.assign(reinterpret_cast<const char*>(rows.data.data()), rows.data.size());
+                    break;
+                }
+            }
+
+            file.write(out.data(), out.size());
+            file.flush();
+            next_row += band.height();
+        }
+
+        void close() {
+            if (file.is_open()) {
+                file.close();
+            }
+        }
+
+    private:
+        std::ofstream file;
+        image_format format = image_format::PPM;
+        int w = 0, h = 0;
+        int next_row = 0;
+        size_t data_start = 0;
+        uint32_t adler = 1;     // running png checksum
+};
+
+#endif
@@ -0,0 +1,300 @@
+#ifndef LIGHT_BVH_HPP
+#define LIGHT_BVH_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include "hittable.hpp"
+#include "constants.hpp"
+
+/*
+    Bounds of a group of emitters: where they are, how much they emit and a cone holding the
+    normals of their emitting sides. Emission of every light is assumed to spread over the
+    hemisphere around its normal
+*/
+struct light_bounds {
+    vec3 lo, hi;
+    vec3 axis = vec3(0, 0, 1);
+    double cos_o = -1;      // cone half angle around axis, -1 when lights face every way
+    double power = 0;
+
+    vec3 center() const { return 0.5 * (lo + hi); }
+
+    /*
+        Estimated contribution of the group to the point p. Distance falloff is taken to the
+        center of the bounds, the cosine falloff uses the smallest angle any light in the
+        group could make with the direction toward p
+    */
+    double importance(const vec3 &p) const {
+        if (power <= 0) return 0;
+
+        vec3 pc = center();
+        double d2 = (p - pc).len_sqrd();
+        double r2 = 0.25 * (hi - lo).len_sqrd();
+        d2 = std::fmax(d2, r2);
+
+        if (cos_o <= -1) {
+            return power / d2;
+        }
+
+        vec3 wi = unit_vector(p - pc);
+        double cos_w = dot(axis, wi);
+        double sin_w = std::sqrt(std::fmax(0.0, 1 - cos_w * cos_w));
+        double sin_o = std::sqrt(std::fmax(0.0, 1 - cos_o * cos_o));
+
+        // angle the bounds subtend from p
+        double cos_b = -1, sin_b = 0;
+        if (!inside(p)) {
+            double sin2_b = std::fmin(r2 / (p - pc).len_sqrd(), 1.0);
+            sin_b = std::sqrt(sin2_b);
+            cos_b = std::sqrt(1 - sin2_b);
+        }
+
+        // cos(max(0, theta_w - theta_o - theta_b))
+        double cos_x = cos_sub_clamped(sin_w, cos_w, sin_o, cos_o);
+        double sin_x = sin_sub_clamped(sin_w, cos_w, sin_o, cos_o);
+        double cos_p = cos_sub_clamped(sin_x, cos_x, sin_b, cos_b);
+
+        if (cos_p <= 0) {
+            return 0;
+        }
+
+        return power * cos_p / d2;
+    }
+
+    bool inside(const vec3 &p) const {
+        return p.x() >= lo.x() && p.x() <= hi.x()
+            && p.y() >= lo.y() && p.y() <= hi.y()
+            && p.z() >= lo.z() && p.z() <= hi.z();
+    }
+
+    static light_bounds merge(const light_bounds &a, const light_bounds &b) {
+        light_bounds m;
+        m.lo = vec3(std::fmin(a.lo.x(), b.lo.x()), std::fmin(a.lo.y(), b.lo.y()), std::fmin(a.lo.z(), b.lo.z()));
+        m.hi = vec3(std::fmax(a.hi.x(), b.hi.x()), std::fmax(a.hi.y(), b.hi.y()), std::fmax(a.hi.z(), b.hi.z()));
+        m.power = a.power + b.power;
+        merge_cones(a, b, m);
+        return m;
+    }
+
+    private:
+        // cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+        static double cos_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+            if (cos_a > cos_b) return 1;
+            return cos_a * cos_b + sin_a * sin_b;
+        }
+
+        static double sin_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+            if (cos_a > cos_b) return 0;
+            return sin_a * cos_b - cos_a * sin_b;
+        }
+
+        static void merge_cones(const light_bounds &a, const light_bounds &b, light_bounds &m) {
+            if (a.cos_o <= -1 || b.cos_o <= -1) {
+                m.cos_o = -1;
+                return;
+            }
+
+            double theta_a = std::acos(std::clamp(a.cos_o, -1.0, 1.0));
+            double theta_b = std::acos(std::clamp(b.cos_o, -1.0, 1.0));
+            double theta_d = std::acos(std::clamp(dot(a.axis, b.axis), -1.0, 1.0));
+
+            if (std::fmin(theta_d + theta_b, pi) <= theta_a) {
+                m.axis = a.axis;
+                m.cos_o = a.cos_o;
+                return;
+            }
+            if (std::fmin(theta_d + theta_a, pi) <= theta_b) {
+                m.axis = b.axis;
+                m.cos_o = b.cos_o;
+                return;
+            }
+
+            double theta_o = (theta_a + theta_d + theta_b) / 2;
+            vec3 k = cross(a.axis, b.axis);
+            if (theta_o >= pi || k.len_sqrd() <= 0) {
+                m.cos_o = -1;
+                return;
+            }
+
+            // rotate a's axis toward b's by theta_o - theta_a
+            k = unit_vector(k);
+            double theta_r = theta_o - theta_a;
+            vec3 v = a.axis;
+            m.axis = unit_vector(v * std::cos(theta_r) + cross(k, v) * std::sin(theta_r)
+                               + k * (dot(k, v) * (1 - std::cos(theta_r))));
+            m.cos_o = std::cos(theta_o);
+        }
+};
+
+/*
+    Hierarchy over many emitters used as the lights argument of the importance sampled
+    integrator. Lights are picked by walking down the tree, choosing each child in proportion
+    to its estimated importance at the shading point
+*/
+class light_bvh : public hittable {
+    public:
+        light_bvh(const std::vector<shared_ptr<hittable>> &emitters) {
+            for (const auto &obj : emitters) {
+                if (obj->power() > 0) {
+                    lights.push_back(obj);
+                }
+            }
+
+            if (lights.empty()) {
+                return;
+            }
+
+            std::vector<int> idx(lights.size());
+            std::vector<light_bounds> bounds(lights.size());
+            for (size_t i = 0; i < lights.size(); i++) {
+                idx[i] = int(i);
+                bounds[i] = bounds_of(*lights[i]);
+            }
+
+            nodes.reserve(2 * lights.size());
+            build(idx, bounds, 0, idx.size());
+
+            bound_box = nodes[0].bounds_box;
+        }
+
+        // only sampled, never intersected
+        bool hit(const ray &r, interval inter, hit_record &rec) const override { return false; }
+
+        axis_bound_box bounding_box() const override { return bound_box; }
+
+        double pdf_value(const vec3 &orig, const vec3 &dir) const override {
+            if (nodes.empty()) {
+                return 0;
+            }
+
+            return node_pdf(0, ray(orig, dir), orig, dir);
+        }
+
+        /*
+            A direction toward a light picked by walking down the tree. The walk can reach a
+            node whose children both look dark from orig although the node did not; the sample
+            then fails with a zero direction, which has no pdf, the same as node_pdf counts no
+            density through such a node
+        */
+        vec3 random(const vec3 &orig) const override {
+            if (nodes.empty()) {
+                return vec3(0, 0, 0);
+            }
+
+            int n = 0;
+            while (nodes[n].light < 0) {
+                double i0 = nodes[n + 1].bounds.importance(orig);
+                double i1 = nodes[nodes[n].second].bounds.importance(orig);
+                if (i0 + i1 <= 0) {
+                    return vec3(0, 0, 0);
+                }
+
+                n = random_double() * (i0 + i1) < i0 ? n + 1 : nodes[n].second;
+            }
+
+            return lights[nodes[n].light]->random(orig);
+        }
+
+        double power() const override {
+            return nodes.empty() ? 0.0 : nodes[0].bounds.power;
+        }
+
+        size_t size() const { return lights.size(); }
+
+    private:
+        // depth first layout, the first child of an interior node directly follows it
+        struct node {
+            light_bounds bounds;
+            axis_bound_box bounds_box;
+            int second = -1;
+            int light = -1;
+        };
+
+        std::vector<shared_ptr<hittable>> lights;
+        std::vector<node> nodes;
+        axis_bound_box bound_box;
+
+        static light_bounds bounds_of(const hittable &obj) {
+            light_bounds b;
+            auto box = obj.bounding_box();
+            b.lo = vec3(box.x.min, box.y.min, box.z.min);
+            b.hi = vec3(box.x.max, box.y.max, box.z.max);
+            b.power = obj.power();
+
+            vec3 n;
+            if (obj.emit_normal(n)) {
+                b.axis = n;
+                b.cos_o = 1;
+            }
+
+            return b;
+        }
+
+        int build(std::vector<int> &idx, const std::vector<light_bounds> &bounds, size_t start, size_t end) {
+            int n = int(nodes.size());
+            nodes.emplace_back();
+
+            if (end - start == 1) {
+                nodes[n].light = idx[start];
+                nodes[n].bounds = bounds[idx[start]];
+                nodes[n].bounds_box = lights[idx[start]]->bounding_box();
+                return n;
+            }
+
+            // median split along the widest axis of the light centers
+            vec3 lo(inf, inf, inf), hi(-inf, -inf, -inf);
+            for (size_t i = start; i < end; i++) {
+                vec3 c = bounds[idx[i]].center();
+                for (int a = 0; a < 3; a++) {
+                    lo[a] = std::fmin(lo[a], c[a]);
+                    hi[a] = std::fmax(hi[a], c[a]);
+                }
+            }
+
+            vec3 ext = hi - lo;
+            int axis = ext.x() > ext.y() ? (ext.x() > ext.z() ? 0 : 2) : (ext.y() > ext.z() ? 1 : 2);
+
+            size_t mid = start + (end - start) / 2;
+            std::nth_element(idx.begin() + start, idx.begin() + mid, idx.begin() + end, [&](int a, int b) {
+                return bounds[a].center()[axis] < bounds[b].center()[axis];
+            });
+
+            int c0 = build(idx, bounds, start, mid);
+            int c1 = build(idx, bounds, mid, end);
+
+            nodes[n].second = c1;
+            nodes[n].bounds = light_bounds::merge(nodes[c0].bounds, nodes[c1].bounds);
+            nodes[n].bounds_box = axis_bound_box(nodes[c0].bounds_box, nodes[c1].bounds_box);
+            return n;
+        }
+
+        /*
+            Probability of sampling dir from orig through the subtree at n. Every light the ray
+            passes through adds its selection probability times its own pdf
+        */
+        double node_pdf(int n, const ray &r, const vec3 &orig, const vec3 &dir) const {
+            const node &nd = nodes[n];
+
+            if (!nd.bounds_box.hit(r, interval(0.001, inf))) {
+                return 0;
+            }
+
+            if (nd.light >= 0) {
+                return lights[nd.light]->pdf_value(orig, dir);
+            }
+
+            double i0 = nodes[n + 1].bounds.importance(orig);
+            double i1 = nodes[nd.second].bounds.importance(orig);
+            if (i0 + i1 <= 0) {
+                return 0;
+            }
+
+            double pdf = 0;
+            if (i0 > 0) pdf += i0 / (i0 + i1) * node_pdf(n + 1, r, orig, dir);
+            if (i1 > 0) pdf += i1 / (i0 + i1) * node_pdf(nd.second, r, orig, dir);
+            return pdf;
+        }
+};
+
+#endif
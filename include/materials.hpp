@@ -1,64 +1,79 @@
 #ifndef MATERIALS_HPP
 #define MATERIALS_HPP
 
+#include <variant>
+#include <vector>
+
 #include "hittable.hpp"
 #include "onb.hpp"
+#include "pdf.hpp"
 
 class scatter_record {
     public:
         color atten;
-        shared_ptr<pdf> pdf_ptr;
+        std::variant<std::monostate, cos_pdf, sphere_pdf> scatter_pdf;  // held by value, no allocation per bounce
         bool skip_pdf;
         ray skip_pdf_ray;
+
+        const pdf *pdf_ptr() const {
+            if (auto p = std::get_if<cos_pdf>(&scatter_pdf)) return p;
+            if (auto p = std::get_if<sphere_pdf>(&scatter_pdf)) return p;
+            return nullptr;
+        }
 };
 
-class material {
+/*
+    What a material does unless it says otherwise: emits nothing and absorbs everything.
+    Materials are plain classes without virtual calls; material picks the kind once per call
+*/
+class material_base {
     public:
-        virtual ~material() = default;
-
-        virtual color emitted(const ray &r, const hit_record &rec, double u, double v, const vec3 &p) const {
+        color emitted(const ray &r, const surface_record &rec, double u, double v, const vec3 &p) const {
             return color(0, 0, 0);
         }
 
-        virtual color emitted(double u, double v, const vec3 &p) const {
+        color emitted(double u, double v, const vec3 &p) const {
             return color(0, 0, 0);
         }
 
-        virtual bool scatter(
-            const ray &r_in, const hit_record& rec, scatter_record &srec
+        bool scatter(
+            const ray &r_in, const surface_record& rec, scatter_record &srec
         ) const {
             return false;
         }
 
-        virtual bool scatter(
-            const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered
+        bool scatter(
+            const ray &r_in, const surface_record &rec, color &attenuation, ray &scattered
         ) const {
             return false;
         }
 
-        virtual double scattering_pdf(const ray &r, const hit_record &rec, const ray &scattered) const {
+        double scattering_pdf(const ray &r, const surface_record &rec, const ray &scattered) const {
             return 0;
         }
 };
 
-class lamber : public material {
+// placeholder material of shapes only used as lights for sampling
+class no_material : public material_base {};
+
+class lamber : public material_base {
     public:
-        lamber(const color &albedo) : tex(make_shared<solid_color>(albedo)) {}
+        lamber(const color &albedo) : tex(scene_make<solid_color>(albedo)) {}
         lamber(const shared_ptr<texture> tex) : tex(tex) {}
 
-        bool scatter(const ray &r, const hit_record &rec, scatter_record &srec) const override {
+        bool scatter(const ray &r, const surface_record &rec, scatter_record &srec) const {
             srec.atten = tex->value(rec.u, rec.v, rec.p);
-            srec.pdf_ptr = make_shared<cos_pdf>(rec.norm);
+            srec.scatter_pdf.emplace<cos_pdf>(rec.norm);
             srec.skip_pdf = false;
             return true;
         }
 
-        double scattering_pdf(const ray &r, const hit_record &rec, const ray& scattered) const override {
+        double scattering_pdf(const ray &r, const surface_record &rec, const ray& scattered) const {
             auto cos_theta = dot(rec.norm, unit_vector(scattered.direction()));
             return cos_theta < 0 ? 0 : cos_theta / pi;
         }
 
-        bool scatter(const ray &r, const hit_record &rec, color &atten, ray &scattered) const override {
+        bool scatter(const ray &r, const surface_record &rec, color &atten, ray &scattered) const {
             auto scatter_dir = rec.norm + random_unit_vector();
 
             if (scatter_dir.near_zero()) {
@@ -74,22 +89,22 @@ class lamber : public material {
         shared_ptr<texture> tex;
 };
 
-class metal : public material {
+class metal : public material_base {
     public:
         metal(const color &albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
 
-        bool scatter(const ray &r, const hit_record &rec, scatter_record &srec) const override {
+        bool scatter(const ray &r, const surface_record &rec, scatter_record &srec) const {
             vec3 reflected = unit_vector(reflect(r.direction(), rec.norm)) + (fuzz * random_unit_vector());
 
             srec.atten = albedo;
-            srec.pdf_ptr = nullptr;
+            srec.scatter_pdf = std::monostate();
             srec.skip_pdf = true;
             srec.skip_pdf_ray = ray(rec.p, reflected, r.time());
 
             return true;
         }
 
-        bool scatter(const ray &r, const hit_record &rec, color &atten, ray &scattered) const override {
+        bool scatter(const ray &r, const surface_record &rec, color &atten, ray &scattered) const {
             vec3 reflected = unit_vector(reflect(r.direction(), rec.norm)) + (fuzz * random_unit_vector());
             scattered = ray(rec.p, reflected, r.time());
             atten = albedo;
@@ -101,13 +116,13 @@ class metal : public material {
         double fuzz;
 };
 
-class dielectric : public material {
+class dielectric : public material_base {
     public:
         dielectric(double refrac_idx) : refrac_idx(refrac_idx) {};
 
-        bool scatter(const ray&r, const hit_record &rec, scatter_record &srec) const override {
+        bool scatter(const ray&r, const surface_record &rec, scatter_record &srec) const {
             srec.atten = color(1.0, 1.0, 1.0);
-            srec.pdf_ptr = nullptr;
+            srec.scatter_pdf = std::monostate();
             srec.skip_pdf = true;
 
             double ri = rec.facing ? (1.0 / refrac_idx) : refrac_idx;
@@ -129,7 +144,7 @@ class dielectric : public material {
             return true;
         }
 
-        bool scatter(const ray&r, const hit_record &rec, color &atten, ray &scattered) const override {
+        bool scatter(const ray&r, const surface_record &rec, color &atten, ray &scattered) const {
             atten = color(1.0, 1.0, 1.0);
             double ri = rec.facing ? (1.0 / refrac_idx) : refrac_idx;
 
@@ -160,44 +175,44 @@ class dielectric : public material {
         }
 };
 
-class diffuse_light : public material {
+class diffuse_light : public material_base {
     public:
         diffuse_light(shared_ptr<texture> tex) : tex(tex) {}
 
-        diffuse_light(const color &emit) : tex(make_shared<solid_color>(emit)) {}
+        diffuse_light(const color &emit) : tex(scene_make<solid_color>(emit)) {}
 
-        color emitted(const ray &r, const hit_record &rec, double u, double v, const vec3 &p) const override { 
+        color emitted(const ray &r, const surface_record &rec, double u, double v, const vec3 &p) const { 
             if (!rec.facing) {
                 return color(0, 0, 0);
             }
             return tex->value(u, v, p); 
         }
 
-        color emitted(double u, double v, const vec3 &p) const override { return tex->value(u, v, p); }
+        color emitted(double u, double v, const vec3 &p) const { return tex->value(u, v, p); }
 
     private:
         shared_ptr<texture> tex;
 };
 
-class isotropic : public material {
+class isotropic : public material_base {
     public:
-        isotropic(const color &albedo) : tex(make_shared<solid_color>(albedo)) {}
+        isotropic(const color &albedo) : tex(scene_make<solid_color>(albedo)) {}
         isotropic(shared_ptr<texture> tex) : tex(tex) {}
 
-        bool scatter(const ray &r, const hit_record &rec, scatter_record &srec) const override {
+        bool scatter(const ray &r, const surface_record &rec, scatter_record &srec) const {
             srec.atten = tex->value(rec.u, rec.v, rec.p);
-            srec.pdf_ptr = make_shared<sphere_pdf>();
+            srec.scatter_pdf.emplace<sphere_pdf>();
             srec.skip_pdf = false;
             return true;
         }
 
-        bool scatter(const ray &r, const hit_record &rec, color &atten, ray &scattered) const override {
+        bool scatter(const ray &r, const surface_record &rec, color &atten, ray &scattered) const {
             scattered = ray(rec.p, random_unit_vector(), r.time());
             atten = tex->value(rec.u, rec.v, rec.p);
             return true;
         }
 
-        double scattering_pdf(const ray &r, const hit_record &rec, const ray &scattered) const override {
+        double scattering_pdf(const ray &r, const surface_record &rec, const ray &scattered) const {
             return 1 / (4 * pi);
         }
 
@@ -205,4 +220,83 @@ class isotropic : public material {
         shared_ptr<texture> tex;
 };
 
+/*
+    A material of a closed set of kinds, held by value. Every call is one switch over the kind
+    (std::visit) into a non-virtual member, so shading code can be inlined per kind. Textures
+    stay virtual
+*/
+class material {
+    public:
+        using kinds = std::variant<no_material, lamber, metal, dielectric, diffuse_light, isotropic>;
+
+        material() {}
+
+        template <typename T>
+        material(T m) : kind(std::move(m)) {}
+
+        // index of the kind in kinds, for grouping hits by material kind
+        size_t kind_index() const { return kind.index(); }
+
+        color emitted(const ray &r, const surface_record &rec, double u, double v, const vec3 &p) const {
+            return std::visit([&](const auto &m) { return m.emitted(r, rec, u, v, p); }, kind);
+        }
+
+        color emitted(double u, double v, const vec3 &p) const {
+            return std::visit([&](const auto &m) { return m.emitted(u, v, p); }, kind);
+        }
+
+        bool scatter(const ray &r_in, const surface_record &rec, scatter_record &srec) const {
+            return std::visit([&](const auto &m) { return m.scatter(r_in, rec, srec); }, kind);
+        }
+
+        bool scatter(const ray &r_in, const surface_record &rec, color &attenuation, ray &scattered) const {
+            return std::visit([&](const auto &m) { return m.scatter(r_in, rec, attenuation, scattered); }, kind);
+        }
+
+        double scattering_pdf(const ray &r, const surface_record &rec, const ray &scattered) const {
+            return std::visit([&](const auto &m) { return m.scattering_pdf(r, rec, scattered); }, kind);
+        }
+
+    private:
+        kinds kind;
+};
+
+/*
+    Every material of the scene in one flat array, looked up by material_id; entry 0 is the
+    placeholder. Materials are only added while the scene is built, so render threads read
+    it without locking
+*/
+class material_table {
+    public:
+        material_table() { mats.emplace_back(no_material()); }
+
+        material_id add(material mat) {
+            mats.push_back(std::move(mat));
+            return material_id(mats.size() - 1);
+        }
+
+        const material &operator[](material_id id) const { return mats[id]; }
+
+        size_t size() const { return mats.size(); }
+
+    private:
+        std::vector<material> mats;
+};
+
+// Table the materials of this process's scene live in
+inline material_table &scene_materials() {
+    static material_table table;
+    return table;
+}
+
+inline const material &material_of(material_id id) {
+    return scene_materials()[id];
+}
+
+// adds a material of kind T, built from T's constructor arguments, to the scene's table
+template <typename T, typename... Args>
+material_id make_material(Args&&... args) {
+    return scene_materials().add(material(T(std::forward<Args>(args)...)));
+}
+
 #endif
\ No newline at end of file
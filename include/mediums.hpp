@@ -10,10 +10,10 @@
 class medium : public hittable {
     public:
         medium(shared_ptr<hittable> boundary, double dens, shared_ptr<texture> tex)
-            : boundary(boundary), neg_inv_dens(-1 / dens), phase(make_shared<isotropic>(tex)) {}
+            : boundary(boundary), neg_inv_dens(-1 / dens), phase(make_material<isotropic>(tex)) {}
 
         medium(shared_ptr<hittable> boundary, double dens, const color &albedo)
-            : boundary(boundary), neg_inv_dens(-1 / dens), phase(make_shared<isotropic>(albedo)) {}
+            : boundary(boundary), neg_inv_dens(-1 / dens), phase(make_material<isotropic>(albedo)) {}
 
         bool hit(const ray &r, interval inter, hit_record &rec) const override {
             hit_record r1, r2;
@@ -41,14 +41,18 @@ class medium : public hittable {
                 return false;
             }
 
-            rec.t = r1.t + hit_dist / r_len;
+            rec.set_hit(r1.t + hit_dist / r_len, this);
+
+            return true;  
+        }
+
+        // scattering inside has no real surface, the normal is arbitrary
+        void surface(const ray &r, surface_record &rec) const override {
             rec.p = r.at(rec.t);
 
             rec.norm = vec3(1, 0, 0);
             rec.facing = true;
             rec.mat = phase;
-
-            return true;  
         }
 
         axis_bound_box bounding_box() const override { return boundary->bounding_box(); }
@@ -56,7 +60,7 @@ class medium : public hittable {
     private:
         shared_ptr<hittable> boundary;
         double neg_inv_dens;
-        shared_ptr<material> phase;
+        material_id phase;
 };
 
 #endif
\ No newline at end of file
@@ -2,16 +2,19 @@
 #define MESH_LOADER_HPP
 
 #include <fstream>
+#include <sstream>
 #include <vector>
 #include <string>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "vec3.hpp"
 #include "shapes.hpp"
 
 class obj_loader {
     public:
-        bool load(const std::string &fn, std::shared_ptr<material> mat) {
+        bool load(const std::string &fn, material_id mat) {
 
             std::ifstream file(fn);
             if (!file.is_open()) {
@@ -33,7 +36,7 @@ class obj_loader {
                 } else if (prefix == "f") {
                     double v0, v1, v2;
                     iss >> v0 >> v1 >> v2;
-                    faces.push_back(std::make_shared<triangle>(
+                    faces.push_back(scene_make<triangle>(
                         vertices[v0-1], vertices[v1-1], vertices[v2-1], mat));
                 }
             }
@@ -68,8 +71,11 @@ class obj_loader {
                 } else if (prefix == "f") {
                     double v0, v1, v2;
                     iss >> v0 >> v1 >> v2;
-                    faces.push_back(std::make_shared<triangle>(
+                    faces.push_back(scene_make<triangle>(
                         vertices[v0-1], vertices[v1-1], vertices[v2-1], mats[current_mat]));
+                    if (emissive.count(current_mat)) {
+                        lights.push_back(faces.back());
+                    }
                 } else if (prefix == "usemtl") {
                     iss >> current_mat;
                 }
@@ -83,10 +89,15 @@ class obj_loader {
 
         std::vector<std::shared_ptr<triangle>> get_triangles() { return faces; }
 
+        // triangles using an emissive (Ke) material, for building a light_bvh
+        std::vector<std::shared_ptr<hittable>> get_lights() { return lights; }
+
     private:
         std::vector<vec3> vertices;
         std::vector<std::shared_ptr<triangle>> faces;
-        std::unordered_map<std::string, std::shared_ptr<material>> mats;
+        std::vector<std::shared_ptr<hittable>> lights;
+        std::unordered_map<std::string, material_id> mats;
+        std::unordered_set<std::string> emissive;
 
         bool load_mats(const std::string &mtl_fn) {
             std::ifstream file(mtl_fn);
@@ -110,7 +121,7 @@ class obj_loader {
                 if (prefix == "newmtl") {
                     if (!current_mat.empty()) {
                         // add the last parsed mat
-                        mats[current_mat] = create_mat(ka, kd, ks, ke, ni, d, illum, ns);
+                        add_mat(current_mat, ka, kd, ks, ke, ni, d, illum, ns);
                     }
                     iss >> current_mat;
                     ka = kd = ks = ke = vec3(0, 0, 0);
@@ -137,39 +148,49 @@ class obj_loader {
             }
 
             if (!current_mat.empty()) {
-                mats[current_mat] = create_mat(ka, kd, ks, ke, ni, d, illum, ns);
+                add_mat(current_mat, ka, kd, ks, ke, ni, d, illum, ns);
             }
 
             file.close();
             return true;
         }
 
-        std::shared_ptr<material> create_mat(
+        void add_mat(const std::string &name,
+            const vec3 &ka, const vec3 &kd, const vec3 &ks, const vec3 &ke,
+            double ni, double d, int illum, double ns)
+        {
+            mats[name] = create_mat(ka, kd, ks, ke, ni, d, illum, ns);
+            if (ke.e[0] > 0 || ke.e[1] > 0 || ke.e[2] > 0) {
+                emissive.insert(name);
+            }
+        }
+
+        material_id create_mat(
             const vec3 &ka, const vec3 &kd, const vec3 &ks, const vec3 &ke, 
             double ni, double d, int illum, double ns) 
         {
             
             if (ke.e[0] > 0 || ke.e[1] > 0 || ke.e[2] > 0) {
                 // emissive material (lights)
-                return std::make_shared<diffuse_light>(ke);
+                return make_material<diffuse_light>(ke);
             }
 
             if (ni > 1.0) {
                 // Dialectric material (glass)
                 std::clog << "\nmaking glass material" << std::flush;
-                return std::make_shared<dielectric>(ni);
+                return make_material<dielectric>(ni);
             }
 
             if (ks.e[0] > 0 || ks.e[1] > 0 || ks.e[2] > 0) {
                 // Metalic material (metal)
                 double fuzz = 1.0 / (1.0 + std::sqrt(ns));
                 std::clog << "\nmaking metal material with a fuzz of: " << fuzz << " and vec3 of: " << kd.x() << " " << kd.y() << " " << kd.z() << std::flush;
-                return std::make_shared<metal>(kd, 0.1);
+                return make_material<metal>(kd, 0.1);
             }
 
             // default make lambertian material
             std::clog << "\nmaking lambertian material" << std::flush;
-            return std::make_shared<lamber>(kd);
+            return make_material<lamber>(kd);
         }
 };
 
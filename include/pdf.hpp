@@ -31,6 +31,16 @@ inline vec3 random_to_sphere(double radius, double distance_squared){
     return vec3(x, y, z);
 }
 
+/*
+    Power heuristic (beta = 2) weight for a sample drawn from the strategy with pdf f,
+    when the same direction could also have been drawn by a strategy with pdf g
+*/
+inline double power_heuristic(double f, double g) {
+    auto f2 = f * f;
+    auto g2 = g * g;
+    return f2 + g2 > 0 ? f2 / (f2 + g2) : 0;
+}
+
 class pdf {
     public:
         virtual ~pdf() {}
@@ -69,41 +79,4 @@ class cos_pdf : public pdf {
         onb uvw;
 };
 
-class hittable_pdf : public pdf {
-    public:
-        hittable_pdf(const hittable &objs, const vec3 &orig) : objs(objs), orig(orig) {}
-
-        double value(const vec3 &dir) const override {
-            return objs.pdf_value(orig, dir);
-        }
-
-        vec3 generate() const override {
-            return objs.random(orig);
-        }
-
-    private:
-        const hittable &objs;
-        vec3 orig;
-};
-
-class mix_pdf : public pdf {
-    public:
-        mix_pdf(shared_ptr<pdf> p0, shared_ptr<pdf> p1) {
-            p[0] = p0;
-            p[1] = p1;
-        }
-
-        double value(const vec3& dir) const override {
-            return 0.5 * p[0]->value(dir) + 0.5 * p[1]->value(dir);
-        }
-
-        vec3 generate() const override {
-            if (random_double() < 0.5) return p[0]->generate();
-            else return p[1]->generate();
-        }
-
-    private:
-        shared_ptr<pdf> p[2];
-};
-
 #endif
\ No newline at end of file
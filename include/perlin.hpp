@@ -4,7 +4,7 @@
 #include "vec3.hpp"
 
 inline double rand_double_perlin(int min, int max) {
-    return std::rand() / (RAND_MAX + 1.0);
+    return random_double();
 }
 
 inline int rand_int_perlin(int min, int max) {
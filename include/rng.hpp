@@ -0,0 +1,50 @@
+#ifndef RNG_HPP
+#define RNG_HPP
+
+#include <cstdint>
+
+/*
+    PCG32 (XSH RR) generator. Small state, fast and statistically much better than std::rand,
+    and cheap enough to reseed for every pixel sample
+*/
+class pcg32 {
+    public:
+        uint64_t state = 0x853c49e6748fea9bULL;
+        uint64_t inc = 0xda3e39cb94b95bdbULL;
+
+        pcg32() {}
+        pcg32(uint64_t init_state, uint64_t init_seq) { seed(init_state, init_seq); }
+
+        void seed(uint64_t init_state, uint64_t init_seq) {
+            state = 0;
+            inc = (init_seq << 1) | 1;
+            next();
+            state += init_state;
+            next();
+        }
+
+        uint32_t next() {
+            uint64_t old = state;
+            state = old * 6364136223846793005ULL + inc;
+            uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+            uint32_t rot = uint32_t(old >> 59);
+            return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+        }
+
+        // uniform in [0, 1)
+        double next_double() {
+            return next() * (1.0 / 4294967296.0);
+        }
+};
+
+// 64 bit finalizer from splitmix64, spreads nearby keys (pixel indices) over the whole range
+inline uint64_t mix_bits(uint64_t v) {
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185ULL;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44dULL;
+    v ^= v >> 33;
+    return v;
+}
+
+#endif
@@ -0,0 +1,312 @@
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+#include <cmath>
+#include <cstdint>
+
+#include "rng.hpp"
+
+/*
+    Sample generators for a pixel sample's random numbers.
+        RANDOM: independent PCG32 numbers
+        HALTON: Owen scrambled Halton, one prime base per dimension
+        SOBOL:  Owen scrambled Sobol (0,2) sequence padded over pairs of dimensions
+*/
+enum class sampler_type {
+    RANDOM,
+    HALTON,
+    SOBOL
+};
+
+/*
+    Dimension layout of one camera path. Every decision of a bounce gets its own fixed range
+    of dimensions. A decision that draws more numbers than its range holds (rejection loops,
+    deep light trees, many media along a ray) gets hashed independent numbers for the rest, so
+    no decision ever sees the dimensions of another one
+*/
+namespace sample_dims {
+    struct step {
+        int first;      // first dimension, relative to the bounce for per bounce steps
+        int count;      // dimensions it may take before falling back to hashed numbers
+    };
+
+    const step pixel = {0, 2};      // 2d sub pixel position
+    const step lens = {2, 2};       // 2d defocus disk
+    const step time = {4, 2};       // motion blur time
+    const int camera = 6;           // dims used before the first bounce
+
+    const step hit = {0, 4};        // per bounce: stochastic intersections (media)
+    const step light = {4, 8};      // light choice and point on the light
+    const step bsdf = {12, 8};      // material scatter direction
+    const step roulette = {20, 2};  // russian roulette
+    const int bounce = 22;          // dims used by one bounce
+
+    inline step of_bounce(int b, step s) { return {camera + b * bounce + s.first, s.count}; }
+}
+
+inline uint32_t reverse_bits32(uint32_t v) {
+    v = (v << 16) | (v >> 16);
+    v = ((v & 0x00ff00ff) << 8) | ((v & 0xff00ff00) >> 8);
+    v = ((v & 0x0f0f0f0f) << 4) | ((v & 0xf0f0f0f0) >> 4);
+    v = ((v & 0x33333333) << 2) | ((v & 0xcccccccc) >> 2);
+    v = ((v & 0x55555555) << 1) | ((v & 0xaaaaaaaa) >> 1);
+    return v;
+}
+
+/*
+    Hash based nested uniform (Owen) scramble of a 32 bit fraction (Laine-Karras style). The
+    top k output bits only depend on the top k input bits, so it also permutes any power of
+    two prefix
+*/
+inline uint32_t owen_scramble(uint32_t v, uint32_t seed) {
+    v = reverse_bits32(v);
+    v ^= v * 0x3d20adea;
+    v += seed;
+    v *= (seed >> 16) | 1;
+    v ^= v * 0x05526c56;
+    v ^= v * 0x53a22864;
+    return reverse_bits32(v);
+}
+
+// element i of a pseudo random permutation of [0, n) picked by seed (Kensler)
+inline uint32_t permutation_element(uint32_t i, uint32_t n, uint32_t seed) {
+    uint32_t w = n - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+
+    do {
+        i ^= seed;
+        i *= 0xe170893d;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3f;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= n);
+
+    return (i + seed) % n;
+}
+
+// first two dimensions of the Sobol sequence as 32 bit fractions
+inline uint32_t sobol_dim0(uint32_t a) {
+    return reverse_bits32(a);
+}
+
+inline uint32_t sobol_dim1(uint32_t a) {
+    uint32_t v = 1u << 31;
+    uint32_t x = 0;
+    for (; a; a >>= 1, v ^= v >> 1) {
+        if (a & 1) x ^= v;
+    }
+    return x;
+}
+
+inline double fraction_to_double(uint32_t v) {
+    return v * (1.0 / 4294967296.0);
+}
+
+/*
+    Radical inverse of a in the given base with every digit permuted by a hash of the digits
+    below it, i.e. an Owen scrambled Halton coordinate
+*/
+inline double owen_radical_inverse(uint64_t a, uint32_t base, uint32_t seed) {
+    double inv_base = 1.0 / base;
+    double inv_base_m = 1;
+    uint64_t reversed = 0;
+
+    while (1.0f - float(inv_base_m) < 1.0f) {
+        uint64_t next = a / base;
+        uint32_t digit = uint32_t(a - next * base);
+        digit = permutation_element(digit, base, uint32_t(mix_bits(seed ^ reversed)));
+        reversed = reversed * base + digit;
+        inv_base_m *= inv_base;
+        a = next;
+    }
+
+    return std::fmin(inv_base_m * reversed, 0.99999999999999989);
+}
+
+// maps [0, 1)^2 onto the unit disk keeping strata intact (Shirley-Chiu)
+inline void concentric_disk(double u, double v, double &x, double &y) {
+    double ox = 2 * u - 1;
+    double oy = 2 * v - 1;
+
+    if (ox == 0 && oy == 0) {
+        x = y = 0;
+        return;
+    }
+
+    const double quarter_pi = 0.78539816339744831;
+    double r, theta;
+    if (std::fabs(ox) > std::fabs(oy)) {
+        r = ox;
+        theta = quarter_pi * (oy / ox);
+    } else {
+        r = oy;
+        theta = 2 * quarter_pi - quarter_pi * (ox / oy);
+    }
+
+    x = r * std::cos(theta);
+    y = r * std::sin(theta);
+}
+
+/*
+    Per-thread source of the numbers random_double() hands out. The camera starts it for every
+    pixel sample and moves it to the range of dimensions of each step of a path; every draw in
+    between takes the next dimension, until the range runs out. Pairs of consecutive draws from
+    the Sobol sampler form one 2D point
+*/
+class sample_stream {
+    public:
+        void start(sampler_type t, uint64_t seed, int i, int j, int index, int spp) {
+            type = t;
+            pixel_hash = mix_bits(((uint64_t(uint32_t(j)) << 32) | uint32_t(i)) ^ mix_bits(seed));
+            rng.seed(pixel_hash, uint64_t(index));
+            sample_index = uint32_t(index);
+
+            log2_spp = 0;
+            while ((1 << log2_spp) < spp && log2_spp < 31) log2_spp++;
+
+            set_dimension(sample_dims::step{0, 1 << 30});
+        }
+
+        void set_dimension(sample_dims::step s) {
+            dim = s.first;
+            dim_end = s.first + s.count;
+            spilled = 0;
+            has_pending = false;
+        }
+
+        double next() {
+            switch (type) {
+                case sampler_type::SOBOL: return next_sobol();
+                case sampler_type::HALTON: return next_halton();
+                default: return rng.next_double();
+            }
+        }
+
+        pcg32 rng;
+
+    private:
+        sampler_type type = sampler_type::RANDOM;
+        uint64_t pixel_hash = 0;
+        uint32_t sample_index = 0;
+        int log2_spp = 0;
+        int dim = 0;
+        int dim_end = 0;        // end of the current step's range
+        uint32_t spilled = 0;   // numbers the current step drew past its range
+
+        bool has_pending = false;
+        double pending = 0;
+
+        uint64_t dim_hash(int d) const {
+            return mix_bits(pixel_hash ^ (uint64_t(d + 1) * 0x9e3779b97f4a7c15ULL));
+        }
+
+        /*
+            Shuffles sample indices so padded dimensions are not correlated with each other. The
+            shuffle is a nested scramble of the index bits, so every aligned power of two run of
+            indices lands on another aligned run and any sample count (not just powers of two)
+            still splits into well stratified nets
+        */
+        uint32_t permuted_index(uint32_t seed) const {
+            if (log2_spp == 0) return sample_index;
+            int shift = 32 - log2_spp;
+            return owen_scramble(sample_index << shift, seed) >> shift;
+        }
+
+        // a number past the step's range: hashed from the step and how far past it is
+        double next_spilled() {
+            uint64_t h = mix_bits(mix_bits(dim_hash(dim_end) ^ sample_index) + spilled++);
+            return fraction_to_double(uint32_t(h >> 32));
+        }
+
+        double next_sobol() {
+            if (has_pending) {
+                has_pending = false;
+                return pending;
+            }
+
+            if (dim + 2 > dim_end) {
+                return next_spilled();
+            }
+
+            uint64_t h = dim_hash(dim);
+            uint32_t idx = permuted_index(uint32_t(h));
+
+            double x = fraction_to_double(owen_scramble(sobol_dim0(idx), uint32_t(h)));
+            pending = fraction_to_double(owen_scramble(sobol_dim1(idx), uint32_t(h >> 32)));
+            has_pending = true;
+            dim += 2;
+
+            return x;
+        }
+
+        double next_halton() {
+            static const uint32_t primes[] = {
+                  2,   3,   5,   7,  11,  13,  17,  19,  23,  29,  31,  37,  41,  43,  47,  53,
+                 59,  61,  67,  71,  73,  79,  83,  89,  97, 101, 103, 107, 109, 113, 127, 131,
+                137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223,
+                227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311
+            };
+
+            if (dim >= dim_end) {
+                return next_spilled();
+            }
+
+            // past the prime table fall back to independent numbers
+            if (dim >= int(sizeof(primes) / sizeof(primes[0]))) {
+                dim++;
+                return rng.next_double();
+            }
+
+            double v = owen_radical_inverse(sample_index, primes[dim], uint32_t(dim_hash(dim)));
+            dim++;
+            return v;
+        }
+};
+
+/*
+    The stream random_double() draws from on this thread: the thread's own, unless a wavefront
+    path or packet ray has pointed it at the stream that path carries
+*/
+inline sample_stream *&active_sample_stream() {
+    thread_local sample_stream own;
+    thread_local sample_stream *active = &own;
+    return active;
+}
+
+inline sample_stream &thread_sampler() {
+    return *active_sample_stream();
+}
+
+// points the thread at other streams for a while, and back at the one it had once it goes
+class sampler_scope {
+    public:
+        sampler_scope() : saved(active_sample_stream()) {}
+        ~sampler_scope() { active_sample_stream() = saved; }
+
+        sampler_scope(const sampler_scope &) = delete;
+        sampler_scope &operator=(const sampler_scope &) = delete;
+
+        void use(sample_stream &s) { active_sample_stream() = &s; }
+
+    private:
+        sample_stream *saved;
+};
+
+#endif
@@ -6,17 +6,27 @@
 #include "hittable.hpp"
 #include "vec3.hpp"
 #include "constants.hpp"
+#include "materials.hpp"
+
+/*
+    Power of an emitter of the given area. Objects whose material does not emit (like the
+    placeholder materials used for light lists) count as unit radiance
+*/
+inline double emitter_power(material_id mat, double area, const vec3 &p) {
+    double radiance = luminance(material_of(mat).emitted(0.5, 0.5, p));
+    return area * (radiance > 0 ? radiance : 1.0);
+}
 
 class sphere : public hittable {
     public:
         // static sphere, not moving
-        sphere(const vec3 &center, double rad, shared_ptr<material> mat) : center(center, vec3(0, 0, 0)), rad(std::fmax(0, rad)), mat(mat) {
+        sphere(const vec3 &center, double rad, material_id mat) : center(center, vec3(0, 0, 0)), rad(std::fmax(0, rad)), mat(mat) {
             auto rvec = vec3(rad, rad, rad);
             bound_box = axis_bound_box(center - rvec, center + rvec);
         }
 
         // moving sphere object
-        sphere(const vec3 &c1, const vec3 &c2, double rad, shared_ptr<material> mat) : center(c1, c2 - c1), rad(std::fmax(0, rad)), mat(mat) {
+        sphere(const vec3 &c1, const vec3 &c2, double rad, material_id mat) : center(c1, c2 - c1), rad(std::fmax(0, rad)), mat(mat) {
             auto rvec = vec3(rad, rad, rad);
             axis_bound_box b1(center.at(0) - rvec, center.at(0) + rvec);
             axis_bound_box b2(center.at(1) - rvec, center.at(1) + rvec);
@@ -54,19 +64,22 @@ class sphere : public hittable {
                 }
             }
 
-            rec.t = rt;
+            rec.set_hit(rt, this);
+
+            return true;
+        }
+
+        void surface(const ray &r, surface_record &rec) const override {
             rec.p = r.at(rec.t);
-            vec3 out = (rec.p - cur_center) / rad;
+            vec3 out = (rec.p - center.at(r.time())) / rad;
             rec.set_facing(r, out);
             get_sphere_uv(out, rec.u, rec.v);
             rec.mat = mat;
-
-            return true;
         }
 
         axis_bound_box bounding_box() const override { return bound_box; }
 
-        double pdf_val(const vec3 &orig, const vec3 &dir) {
+        double pdf_value(const vec3 &orig, const vec3 &dir) const override {
             // only works with non-moving spheres
             hit_record rec;
             if (!this->hit(ray(orig, dir), interval(0.001, inf), rec)) {
@@ -87,10 +100,14 @@ class sphere : public hittable {
             return uvw.transform(rand_to_sphere(rad, dist_sqrd));
         }
 
+        double power() const override {
+            return emitter_power(mat, 4 * pi * rad * rad, center.at(0));
+        }
+
     private:
         ray center;
         double rad;
-        shared_ptr<material> mat;
+        material_id mat;
         axis_bound_box bound_box;
 
         static vec3 rand_to_sphere(double rad, double dist_sqrd) {
@@ -108,7 +125,7 @@ class sphere : public hittable {
 
 class quad : public hittable {
     public:
-        quad(const vec3 &Q, const vec3 &u, const vec3 &v, shared_ptr<material> mat) : Q(Q), u(u), v(v), mat(mat) { 
+        quad(const vec3 &Q, const vec3 &u, const vec3 &v, material_id mat) : Q(Q), u(u), v(v), mat(mat) { 
             auto n = cross(u, v);
             norm = unit_vector(n);
             D = dot(norm, Q);
@@ -149,14 +166,17 @@ class quad : public hittable {
                 return false;
             }
 
-            rec.t = t;
-            rec.p = intersection;
-            rec.mat = mat;
-            rec.set_facing(r, norm);
+            rec.set_hit(t, this);
 
             return true;
         }
 
+        void surface(const ray &r, surface_record &rec) const override {
+            rec.p = r.at(rec.t);
+            rec.mat = mat;
+            rec.set_facing(r, norm);
+        }
+
         virtual bool is_interior(double a, double b, hit_record &rec) const {
             interval unit_interval = interval(0, 1);
 
@@ -176,7 +196,7 @@ class quad : public hittable {
             }
 
             auto dist_sqrd = rec.t * rec.t * dir.len_sqrd();
-            auto cos = std::fabs(dot(dir, rec.norm) / dir.len());
+            auto cos = std::fabs(dot(dir, norm) / dir.len());
 
             return dist_sqrd / (cos * area);
         }
@@ -186,18 +206,27 @@ class quad : public hittable {
             return p - orig;
         }
 
+        double power() const override {
+            return emitter_power(mat, area, Q + 0.5 * (u + v));
+        }
+
+        bool emit_normal(vec3 &n) const override {
+            n = norm;
+            return true;
+        }
+
     private:
         vec3 Q, u, v, w;
-        shared_ptr<material> mat;
+        material_id mat;
         axis_bound_box bound_box;
         vec3 norm;
         double D;
         double area;
 };
 
-shared_ptr<hittable_list> box(const vec3 &a, const vec3 &b, shared_ptr<material> mat) {
+shared_ptr<hittable_list> box(const vec3 &a, const vec3 &b, material_id mat) {
 
-    auto sides = make_shared<hittable_list>();
+    auto sides = scene_make<hittable_list>();
 
     auto min = vec3(std::fmin(a.x(), b.x()), std::fmin(a.y(), b.y()), std::fmin(a.z(), b.z()));
     auto max = vec3(std::fmax(a.x(), b.x()), std::fmax(a.y(), b.y()), std::fmax(a.z(), b.z()));
@@ -206,20 +235,24 @@ shared_ptr<hittable_list> box(const vec3 &a, const vec3 &b, shared_ptr<material>
     auto dy = vec3(0, max.y() - min.y(), 0);
     auto dz = vec3(0, 0, max.z() - min.z());
 
-    sides->add(make_shared<quad>(vec3(min.x(), min.y(), max.z()), dx, dy, mat));    // front
-    sides->add(make_shared<quad>(vec3(max.x(), min.y(), max.z()), -dz, dy, mat));   // right
-    sides->add(make_shared<quad>(vec3(max.x(), min.y(), min.z()), -dx, dy, mat));   // back
-    sides->add(make_shared<quad>(vec3(min.x(), min.y(), min.z()), dz, dy, mat));    // left
-    sides->add(make_shared<quad>(vec3(min.x(), max.y(), max.z()), dx, -dz, mat));   // top
-    sides->add(make_shared<quad>(vec3(min.x(), min.y(), min.z()), dx, dz, mat));    // bottom
+    sides->add(scene_make<quad>(vec3(min.x(), min.y(), max.z()), dx, dy, mat));    // front
+    sides->add(scene_make<quad>(vec3(max.x(), min.y(), max.z()), -dz, dy, mat));   // right
+    sides->add(scene_make<quad>(vec3(max.x(), min.y(), min.z()), -dx, dy, mat));   // back
+    sides->add(scene_make<quad>(vec3(min.x(), min.y(), min.z()), dz, dy, mat));    // left
+    sides->add(scene_make<quad>(vec3(min.x(), max.y(), max.z()), dx, -dz, mat));   // top
+    sides->add(scene_make<quad>(vec3(min.x(), min.y(), min.z()), dx, dz, mat));    // bottom
 
     return sides;  
 }
 
 class triangle : public hittable {
     public:
-        triangle(const vec3 &a, const vec3 &b, const vec3 &c, shared_ptr<material> mat) 
+        triangle(const vec3 &a, const vec3 &b, const vec3 &c, material_id mat) 
             : v0(a), v1(b), v2(c), mat(mat) {
+                auto n = cross(v1 - v0, v2 - v0);
+                area = 0.5 * n.len();
+                norm = area > 0 ? n / (2 * area) : vec3(0, 0, 1);
+
                 set_bounding_box();
         }
 
@@ -245,13 +278,45 @@ class triangle : public hittable {
             double t = f * dot(e2, q);
             if (t < inter.min || t > inter.max) return false;
 
-            rec.t = t;
-            rec.p = r.origin() + r.direction() * t;
-            vec3 norm = cross(e1, e2);
+            rec.set_hit(t, this);
+
+            return true;          
+        }
+
+        void surface(const ray &r, surface_record &rec) const override {
+            rec.p = r.origin() + r.direction() * rec.t;
             rec.set_facing(r, norm);
             rec.mat = mat;
+        }
 
-            return true;          
+        double pdf_value(const vec3 &orig, const vec3 &dir) const override {
+            hit_record rec;
+            if (area <= 0 || !this->hit(ray(orig, dir), interval(0.001, inf), rec)) {
+                return 0;
+            }
+
+            auto dist_sqrd = rec.t * rec.t * dir.len_sqrd();
+            auto cos = std::fabs(dot(dir, norm) / dir.len());
+
+            return dist_sqrd / (cos * area);
+        }
+
+        // uniform by area
+        vec3 random(const vec3 &orig) const override {
+            auto su = std::sqrt(random_double());
+            auto b0 = 1 - su;
+            auto b1 = random_double() * su;
+            auto p = b0 * v0 + b1 * v1 + (1 - b0 - b1) * v2;
+            return p - orig;
+        }
+
+        double power() const override {
+            return emitter_power(mat, area, (v0 + v1 + v2) / 3);
+        }
+
+        bool emit_normal(vec3 &n) const override {
+            n = norm;
+            return true;
         }
 
         virtual void set_bounding_box() {
@@ -277,27 +342,27 @@ class triangle : public hittable {
         vec3 v0, v1, v2;
 
     private:
-        shared_ptr<material> mat;
+        material_id mat;
         axis_bound_box bound_box;
+        vec3 norm;      // unit, on the side cross(v1 - v0, v2 - v0) points to
+        double area;
 };
 
 class triangle_mesh : public hittable {
 public:
-    triangle_mesh(const std::vector<triangle>& triangles, std::shared_ptr<material> mat) 
+    triangle_mesh(const std::vector<triangle>& triangles, material_id mat) 
         : triangles(triangles), mat(mat) {
         set_bounding_box();
     }
 
     bool hit(const ray &r, interval inter, hit_record &rec) const override {
         bool hit_anything = false;
-        hit_record temp_rec;
         double closest_so_far = inter.max;
 
         for (const auto& triangle : triangles) {
-            if (triangle.hit(r, interval(inter.min, closest_so_far), temp_rec)) {
+            if (triangle.hit(r, interval(inter.min, closest_so_far), rec)) {
                 hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec; // Store the closest hit record
+                closest_so_far = rec.t; // rec only changes on a closer hit
             }
         }
         return hit_anything;
@@ -310,7 +375,7 @@ public:
     private:
         std::vector<triangle> triangles;  // Store triangles
         axis_bound_box bound_box;          // Bounding box for the entire mesh
-        std::shared_ptr<material> mat;     // Material for the mesh
+        material_id mat;     // Material for the mesh
 
         void set_bounding_box() {
             // Initialize min and max to extreme values
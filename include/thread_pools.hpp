@@ -3,66 +3,172 @@
 
 // C++ Program to demonstrate thread pooling
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
 using namespace std;
 
+// Bounded lock free multi producer multi consumer
+// queue (Vyukov). Every cell carries a sequence number
+// telling producers and consumers whose turn it is, so
+// both sides only race on one compare exchange
+template <typename T>
+class mpmc_queue {
+public:
+    explicit mpmc_queue(size_t capacity)
+    {
+        size_t n = 2;
+        while (n < capacity) {
+            n *= 2;
+        }
+
+        cells_.reset(new cell[n]);
+        mask_ = n - 1;
+
+        for (size_t i = 0; i < n; ++i) {
+            cells_[i].seq.store(i, memory_order_relaxed);
+        }
+    }
+
+    // False when the queue is full, v is left untouched
+    bool try_push(T &&v)
+    {
+        cell *c;
+        size_t pos = tail_.load(memory_order_relaxed);
+
+        while (true) {
+            c = &cells_[pos & mask_];
+            size_t seq = c->seq.load(memory_order_acquire);
+            intptr_t dif = intptr_t(seq) - intptr_t(pos);
+
+            if (dif == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = tail_.load(memory_order_relaxed);
+            }
+        }
+
+        c->value = move(v);
+        c->seq.store(pos + 1, memory_order_release);
+        return true;
+    }
+
+    // False when the queue is empty
+    bool try_pop(T &v)
+    {
+        cell *c;
+        size_t pos = head_.load(memory_order_relaxed);
+
+        while (true) {
+            c = &cells_[pos & mask_];
+            size_t seq = c->seq.load(memory_order_acquire);
+            intptr_t dif = intptr_t(seq) - intptr_t(pos + 1);
+
+            if (dif == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = head_.load(memory_order_relaxed);
+            }
+        }
+
+        v = move(c->value);
+        c->seq.store(pos + mask_ + 1, memory_order_release);
+        return true;
+    }
+
+private:
+    struct cell {
+        atomic<size_t> seq;
+        T value;
+    };
+
+    unique_ptr<cell[]> cells_;
+    size_t mask_ = 0;
+
+    // producers and consumers on separate cache lines
+    alignas(64) atomic<size_t> tail_{0};
+    alignas(64) atomic<size_t> head_{0};
+};
+
 // Class that represents a simple thread pool
 class ThreadPool {
 public:
     // // Constructor to creates a thread pool with given
     // number of threads
     ThreadPool(size_t num_threads
-               = thread::hardware_concurrency())
+               = thread::hardware_concurrency(),
+               size_t queue_capacity = 1024)
+        : tasks_(queue_capacity)
     {
+        if (num_threads == 0) {
+            num_threads = 1;
+        }
 
-        // Creating worker threads
+        // Every worker owns a deque of tasks, others
+        // steal from it once their own runs dry
         for (size_t i = 0; i < num_threads; ++i) {
-            threads_.emplace_back([this] {
+            local_.emplace_back(make_unique<worker_queue>());
+        }
+
+        // Creating worker threads. Workers never touch
+        // iostreams, progress is printed by the reporter
+        for (size_t i = 0; i < num_threads; ++i) {
+            threads_.emplace_back([this, i] {
                 while (true) {
                     function<void()> task;
-                    // The reason for putting the below code
-                    // here is to unlock the queue before
-                    // executing the task so that other
-                    // threads can perform enqueue tasks
-                    {
-                        // Locking the queue so that data
-                        // can be shared safely
+
+                    if (!take(i, task)) {
+                        // Nothing to run anywhere, sleep
+                        // until a task is queued or the pool
+                        // is stopped
                         unique_lock<mutex> lock(
-                            queue_mutex_);
+                            sleep_mutex_);
 
-                        // Waiting until there is a task to
-                        // execute or the pool is stopped
+                        sleeping_++;
                         cv_.wait(lock, [this] {
-                            return !tasks_.empty() || stop_;
+                            return queued_ > 0 || stop_;
                         });
+                        sleeping_--;
 
                         // exit the thread in case the pool
                         // is stopped and there are no tasks
-                        if (stop_ && tasks_.empty()) {
+                        if (stop_ && queued_ <= 0) {
                             return;
                         }
 
-                        // Get the next task from the queue
-                        task = move(tasks_.front());
-                        tasks_.pop();
+                        continue;
                     }
 
                     task();
 
-                    active_tasks--;
-                    std::clog << "\rProgress: " << max_tasks - active_tasks << "/" << max_tasks << "            " << std::flush;
-                    if (active_tasks <= 0) {
+                    completed_++;
+                    if (active_tasks.fetch_sub(1) == 1) {
+                        // last task, wake whoever waits on
+                        // the pool
+                        lock_guard<mutex> lock(done_mutex_);
+                        runs_++;
                         done.notify_all();
-                        std::clog << "\nDone.                           " << std::flush;
                     }
                 }
             });
         }
+
+        reporter_ = thread([this] { report_progress(); });
     }
 
     // Destructor to stop the thread pool
@@ -70,7 +176,7 @@ public:
     {
         {
             // Lock the queue to update the stop flag safely
-            unique_lock<mutex> lock(queue_mutex_);
+            lock_guard<mutex> lock(sleep_mutex_);
             stop_ = true;
         }
 
@@ -82,50 +188,194 @@ public:
         for (auto& thread : threads_) {
             thread.join();
         }
+
+        {
+            lock_guard<mutex> lock(done_mutex_);
+            reporter_stop_ = true;
+        }
+        done.notify_all();
+        reporter_.join();
     }
 
     void wait_till_done() {
-        std::unique_lock<std::mutex> lock(queue_mutex_);
+        unique_lock<mutex> lock(done_mutex_);
         done.wait(lock, [this]() { return active_tasks == 0; });
     }
 
-    // Enqueue task for execution by the thread pool
+    // Enqueue task for execution by the thread pool.
+    // Blocks while the bounded queue is full
     void enqueue(function<void()> task)
     {
-        {
-            unique_lock<std::mutex> lock(queue_mutex_);
-            tasks_.emplace(move(task));
-            active_tasks++;
-            max_tasks++;
+        start_tasks(1);
+
+        while (!tasks_.try_push(move(task))) {
+            this_thread::yield();
+        }
+
+        wake(1);
+    }
+
+    // Enqueue a batch of tasks, split into contiguous
+    // runs over the workers' own deques. Neighbouring
+    // tasks (e.g. neighbouring image tiles) stay on one
+    // worker until someone steals them
+    void enqueue_batch(vector<function<void()>> batch)
+    {
+        size_t n = local_.size();
+        size_t count = batch.size();
+
+        start_tasks(count);
+
+        for (size_t w = 0; w < n; ++w) {
+            size_t begin = count * w / n;
+            size_t end = count * (w + 1) / n;
+
+            lock_guard<mutex> lock(local_[w]->m);
+            for (size_t k = begin; k < end; ++k) {
+                local_[w]->tasks.emplace_back(move(batch[k]));
+            }
         }
-        cv_.notify_one();
+
+        wake(count);
     }
 
-    // voi/
+    size_t size() const { return threads_.size(); }
 
 private:
+    // Per worker deque. The owner takes from the
+    // front, thieves take from the back so they start
+    // as far from the owner's work as possible
+    struct worker_queue {
+        mutex m;
+        deque<function<void()>> tasks;
+    };
+
     // Vector to store worker threads
     vector<thread> threads_;
 
-    // Queue of tasks
-    queue<function<void()> > tasks_;
+    // Queue of single tasks
+    mpmc_queue<function<void()>> tasks_;
 
-    // Mutex to synchronize access to shared data
-    mutex queue_mutex_;
+    // Deques of batched tasks, one per worker
+    vector<unique_ptr<worker_queue>> local_;
 
-    // Condition variable to signal changes in the state of
-    // the tasks queue
+    // Only taken to sleep and to wake sleepers
+    mutex sleep_mutex_;
     condition_variable cv_;
+
+    // Signals the pool running out of work
+    mutex done_mutex_;
     condition_variable done;
 
-    int active_tasks = 0;
-    int max_tasks;
+    atomic<int> active_tasks{0};    // queued or running
+    atomic<int> queued_{0};         // waiting in any queue
+    atomic<int> sleeping_{0};       // workers blocked on cv_
+
+    // progress of the current run of work, since the
+    // pool was last idle
+    atomic<int> max_tasks{0};
+    atomic<int> completed_{0};
+    int runs_ = 0;                  // runs finished, guarded by done_mutex_
 
     // Flag to indicate whether the thread pool should stop
     // or not
     bool stop_ = false;
 
+    thread reporter_;
+    bool reporter_stop_ = false;
+
+    void start_tasks(size_t count)
+    {
+        // a new run of work starts its progress from 0
+        if (active_tasks.fetch_add(int(count)) == 0) {
+            completed_ = 0;
+            max_tasks = 0;
+        }
+        max_tasks += int(count);
+    }
+
+    // Publishes count new tasks and wakes at most that
+    // many sleeping workers
+    void wake(size_t count)
+    {
+        queued_ += int(count);
 
+        if (sleeping_ > 0) {
+            lock_guard<mutex> lock(sleep_mutex_);
+            if (count == 1) {
+                cv_.notify_one();
+            } else {
+                cv_.notify_all();
+            }
+        }
+    }
+
+    // Next task for worker i: its own deque first, then
+    // the shared queue, then the back of another worker's
+    // deque
+    bool take(size_t i, function<void()> &task)
+    {
+        {
+            lock_guard<mutex> lock(local_[i]->m);
+            if (!local_[i]->tasks.empty()) {
+                task = move(local_[i]->tasks.front());
+                local_[i]->tasks.pop_front();
+                queued_--;
+                return true;
+            }
+        }
+
+        if (tasks_.try_pop(task)) {
+            queued_--;
+            return true;
+        }
+
+        for (size_t k = 1; k < local_.size(); ++k) {
+            auto &victim = *local_[(i + k) % local_.size()];
+            lock_guard<mutex> lock(victim.m);
+            if (!victim.tasks.empty()) {
+                task = move(victim.tasks.back());
+                victim.tasks.pop_back();
+                queued_--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Prints progress a few times a second while there
+    // is work, and once more when a run finishes
+    void report_progress()
+    {
+        int shown = -1;
+        int runs_seen = 0;
+
+        unique_lock<mutex> lock(done_mutex_);
+        while (!reporter_stop_) {
+            done.wait_for(lock, chrono::milliseconds(250));
+
+            int done_count = completed_;
+            int total = max_tasks;
+
+            if (runs_ != runs_seen) {
+                std::clog << "\rProgress: " << total << "/" << total << "            "
+                          << "\nDone.                           " << std::flush;
+                runs_seen = runs_;
+                shown = -1;
+            } else if (active_tasks > 0 && done_count != shown) {
+                std::clog << "\rProgress: " << done_count << "/" << total << "            " << std::flush;
+                shown = done_count;
+            }
+        }
+    }
 };
 
-#endif
\ No newline at end of file
+// Pool shared by every render, its threads stay alive
+// between frames
+inline ThreadPool &render_pool() {
+    static ThreadPool pool(thread::hardware_concurrency());
+    return pool;
+}
+
+#endif
@@ -7,10 +7,13 @@
 #include <cmath>
 #include <cstdlib>
 
+#include "sampler.hpp"
+
 const double pi_vec3 = 3.14159265;
 
+// next number of the current pixel sample, see sample_stream
 inline double random_double() {
-    return std::rand() / (RAND_MAX + 1.0);
+    return thread_sampler().next();
 }
 
 inline double random_double(double min, double max) {
@@ -0,0 +1,119 @@
+#ifndef WAVEFRONT_HPP
+#define WAVEFRONT_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <variant>
+#include <vector>
+
+#include "hittable.hpp"
+#include "materials.hpp"
+#include "sampler.hpp"
+
+/*
+    Paths of one wavefront batch, one array per field. Stages run over lists of path indices
+    (queues) and only touch the fields they need. Every path carries its own sample stream,
+    which the thread draws from while it works on the path, so the path sees the same numbers
+    as it would traced on its own
+*/
+struct path_queue {
+    // current ray
+    std::vector<vec3> orig;
+    std::vector<vec3> dir;
+    std::vector<double> time;
+
+    std::vector<color> throughput;
+    std::vector<color> radiance;
+    std::vector<double> bsdf_pdf;   // pdf of the bsdf sample that made the ray, 0 for camera and specular rays
+    std::vector<vec3> prev_p;       // origin of that bsdf sample
+
+    std::vector<int> pixel;         // tile pixel the path adds to
+    std::vector<sample_stream> stream;
+
+    // closest hit and what its material made of it
+    std::vector<surface_record> rec;
+    std::vector<scatter_record> srec;
+
+    // shadow ray of the next event estimate, a pdf of 0 for none, and the light it found
+    std::vector<vec3> shadow_dir;
+    std::vector<double> shadow_pdf;
+    std::vector<color> shadow_light;
+
+    size_t size() const { return pixel.size(); }
+
+    void resize(size_t n) {
+        orig.resize(n);
+        dir.resize(n);
+        time.resize(n);
+        throughput.resize(n);
+        radiance.resize(n);
+        bsdf_pdf.resize(n);
+        prev_p.resize(n);
+        pixel.resize(n);
+        stream.resize(n);
+        rec.resize(n);
+        srec.resize(n);
+        shadow_dir.resize(n);
+        shadow_pdf.resize(n);
+        shadow_light.resize(n);
+    }
+
+    ray current(size_t p) const { return ray(orig[p], dir[p], time[p]); }
+
+    void set_ray(size_t p, const ray &r) {
+        orig[p] = r.origin();
+        dir[p] = r.direction();
+        time[p] = r.time();
+    }
+};
+
+/*
+    Stable counting sort of a queue of hits by the kind of their material, so the shading
+    stage runs one material's code over all of its hits before moving to the next
+*/
+inline void group_by_material(std::vector<int> &queue, const path_queue &paths) {
+    const size_t kinds = std::variant_size_v<material::kinds>;
+    std::vector<int> start(kinds + 1, 0);
+    for (int p : queue) start[material_of(paths.rec[p].mat).kind_index() + 1]++;
+
+    // all hits of one kind
+    if (std::find(start.begin(), start.end(), int(queue.size())) != start.end()) {
+        return;
+    }
+
+    for (size_t t = 1; t < start.size(); t++) start[t] += start[t - 1];
+
+    std::vector<int> sorted(queue.size());
+    for (int p : queue) {
+        sorted[start[material_of(paths.rec[p].mat).kind_index()]++] = p;
+    }
+    queue.swap(sorted);
+}
+
+/*
+    Thread seconds spent in each wavefront stage over a render, summed over all threads
+*/
+struct stage_times {
+    std::atomic<long long> generate{0}, group{0}, intersect{0}, shade{0}, shadow{0};
+
+    void reset() {
+        generate = group = intersect = shade = shadow = 0;
+    }
+
+    // adds the time since start to counter and restarts start
+    static void lap(std::atomic<long long> &counter, std::chrono::steady_clock::time_point &start) {
+        auto now = std::chrono::steady_clock::now();
+        counter += std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count();
+        start = now;
+    }
+
+    void report() const {
+        auto sec = [](long long ns) { return ns * 1e-9; };
+        std::clog << "\nWavefront stages (thread seconds): generate " << sec(generate)
+                  << ", group " << sec(group) << ", intersect " << sec(intersect)
+                  << ", shade " << sec(shade) << ", shadow " << sec(shadow) << "\n" << std::flush;
+    }
+};
+
+#endif
@@ -8,6 +8,7 @@
 #include "bvh.hpp"
 #include "mesh_loader.hpp"
 #include "mediums.hpp"
+#include "light_bvh.hpp"
 
 enum class scenes {
     CUSTOM,
@@ -45,25 +46,25 @@ enum class camera_settings {
 
 void my_custom_scene(hittable_list &world, camera &cam) {
 
-    auto mat_grnd = make_shared<lamber>(color(0.098, 0.0, 0.2));
-    auto mirror = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-    auto glass = make_shared<dielectric>(1.0 / 1.5);
-    auto glass1 = make_shared<dielectric>(1.5);
-    auto light = make_shared<diffuse_light>(color(10, 10, 10));
-    auto white = make_shared<lamber>(color(0.99, 0.99, 0.99));
+    [[maybe_unused]] auto mat_grnd = make_material<lamber>(color(0.098, 0.0, 0.2));
+    auto mirror = make_material<metal>(color(0.7, 0.6, 0.5), 0.0);
+    auto glass = make_material<dielectric>(1.0 / 1.5);
+    auto glass1 = make_material<dielectric>(1.5);
+    [[maybe_unused]] auto light = make_material<diffuse_light>(color(10, 10, 10));
+    [[maybe_unused]] auto white = make_material<lamber>(color(0.99, 0.99, 0.99));
 
     // world.add(make_shared<sphere>(vec3(0, -1001, 0), 1000, mat_grnd));
-    world.add(make_shared<sphere>(vec3(-1.25, 0, 0), 1.0, glass1));
-    world.add(make_shared<sphere>(vec3(-1.25, 0, 0), 0.5, glass));
-    world.add(make_shared<sphere>(vec3( 1.25, 0, 0), 1.0, mirror));
+    world.add(scene_make<sphere>(vec3(-1.25, 0, 0), 1.0, glass1));
+    world.add(scene_make<sphere>(vec3(-1.25, 0, 0), 0.5, glass));
+    world.add(scene_make<sphere>(vec3( 1.25, 0, 0), 1.0, mirror));
     // world.add(make_shared<sphere>(vec3(0, 4, 0), 1.5, light));
 
-    // auto bg_mat = make_shared<lamber>(color(1.0, 0.0, 0.0));
+    // auto bg_mat = make_material<lamber>(color(1.0, 0.0, 0.0));
     // for (int i = 0; i < 4; i++) {
-    //     world.add(make_shared<sphere>(vec3(-3 + (i * 2), 0.0, -6), 1.0, bg_mat));
+    //     world.add(scene_make<sphere>(vec3(-3 + (i * 2), 0.0, -6), 1.0, bg_mat));
     // }
 
-    // shared_ptr<hittable> cloud = make_shared<sphere>(vec3(0, 4, 0), 3, white);
+    // shared_ptr<hittable> cloud = scene_make<sphere>(vec3(0, 4, 0), 3, white);
     // world.add(make_shared<medium>(cloud, 0.001, color(0.8, 0.8, 0.8)));
 
     cam.img_wd = 1900;
@@ -75,7 +76,7 @@ void my_custom_scene(hittable_list &world, camera &cam) {
 
     cam.defocus_angle = 0;
 
-    cam.bg_tex = make_shared<image_hdr_tex>("./hdr_assets/esplanade.hdr");
+    cam.bg_tex = scene_make<image_hdr_tex>("./hdr_assets/esplanade.hdr");
     cam.bg = color(0, 0, 0);
 
     cam.render(world);
@@ -83,8 +84,8 @@ void my_custom_scene(hittable_list &world, camera &cam) {
 
 void bouncing_spheres(hittable_list &world, camera &cam) {
 
-    auto mat_grnd = make_shared<lamber>(color(0.5, 0.5, 0.5));
-    world.add(make_shared<sphere>(vec3(0, -1000, 0), 1000, mat_grnd));
+    auto mat_grnd = make_material<lamber>(color(0.5, 0.5, 0.5));
+    world.add(scene_make<sphere>(vec3(0, -1000, 0), 1000, mat_grnd));
 
     for (int a = -11; a < 11; a++) {
         for (int b = -11; b < 11; b++) {
@@ -92,33 +93,33 @@ void bouncing_spheres(hittable_list &world, camera &cam) {
             vec3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
 
             if ((center - vec3(4, 0.2, 0)).len() > 0.9) {
-                shared_ptr<material> sphere_mat;
+                material_id sphere_mat;
 
                 if (choose_mat < 0.8) {
                     auto albedo = color::random() * color::random();
-                    sphere_mat = make_shared<lamber>(albedo);
+                    sphere_mat = make_material<lamber>(albedo);
                     auto c2 = center + vec3(0, random_double(0, 0.5), 0);
-                    world.add(make_shared<sphere>(center, c2, 0.2, sphere_mat));
+                    world.add(scene_make<sphere>(center, c2, 0.2, sphere_mat));
                 } else if (choose_mat < 0.95) {
                     auto albedo = color::random(0.5, 1);
                     auto fuzz = random_double(0, 0.5);
-                    sphere_mat = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_mat));
+                    sphere_mat = make_material<metal>(albedo, fuzz);
+                    world.add(scene_make<sphere>(center, 0.2, sphere_mat));
                 } else {
-                    sphere_mat = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_mat));
+                    sphere_mat = make_material<dielectric>(1.5);
+                    world.add(scene_make<sphere>(center, 0.2, sphere_mat));
                 }
             }
         }
     }
 
-    auto mat1 = make_shared<dielectric>(1.5);
-    auto mat2 = make_shared<lamber>(color(0.4, 0.2, 0.1));
-    auto mat3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
+    auto mat1 = make_material<dielectric>(1.5);
+    auto mat2 = make_material<lamber>(color(0.4, 0.2, 0.1));
+    auto mat3 = make_material<metal>(color(0.7, 0.6, 0.5), 0.0);
 
-    world.add(make_shared<sphere>(vec3(0, 1, 0), 1.0, mat1));
-    world.add(make_shared<sphere>(vec3(-4, 1, 0), 1.0, mat2));
-    world.add(make_shared<sphere>(vec3(4, 1, 0), 1.0, mat3));
+    world.add(scene_make<sphere>(vec3(0, 1, 0), 1.0, mat1));
+    world.add(scene_make<sphere>(vec3(-4, 1, 0), 1.0, mat2));
+    world.add(scene_make<sphere>(vec3(4, 1, 0), 1.0, mat3));
 
     cam.lk_from = vec3(13, 2, 3);
     cam.lk_at = vec3(0, 0, 0);
@@ -131,15 +132,15 @@ void bouncing_spheres(hittable_list &world, camera &cam) {
     cam.defocus_angle = 0.6;
     cam.focus_dist = 10.0;
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(scene_make<bvh_node>(world));
     cam.render(world);
 }
 
 void checkered_spheres(hittable_list &world, camera &cam) {
     
-    auto checker = make_shared<checkers>(0.32, color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
-    world.add(make_shared<sphere>(vec3(0, -10, 0), 10, make_shared<lamber>(checker)));
-    world.add(make_shared<sphere>(vec3(0,  10, 0), 10, make_shared<lamber>(checker)));
+    auto checker = scene_make<checkers>(0.32, color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
+    world.add(scene_make<sphere>(vec3(0, -10, 0), 10, make_material<lamber>(checker)));
+    world.add(scene_make<sphere>(vec3(0,  10, 0), 10, make_material<lamber>(checker)));
 
 
     cam.aspect = 16.0 / 9.0;
@@ -153,15 +154,15 @@ void checkered_spheres(hittable_list &world, camera &cam) {
     cam.vup = vec3(0, 1, 0);
     cam.defocus_angle = 0;
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(scene_make<bvh_node>(world));
     cam.render(world);
 
 }
 
 void perlin_sphere(hittable_list &world, camera &cam) {
-    auto perlin = make_shared<noise_tex>(4);
-    world.add(make_shared<sphere>(vec3(0, -1000, 0), 1000, make_shared<lamber>(perlin)));
-    world.add(make_shared<sphere>(vec3(0, 2, 0), 2, make_shared<lamber>(perlin)));
+    auto perlin = scene_make<noise_tex>(4);
+    world.add(scene_make<sphere>(vec3(0, -1000, 0), 1000, make_material<lamber>(perlin)));
+    world.add(scene_make<sphere>(vec3(0, 2, 0), 2, make_material<lamber>(perlin)));
 
     cam.aspect = 16.0 / 9.0;
     cam.img_wd = 400;
@@ -174,22 +175,22 @@ void perlin_sphere(hittable_list &world, camera &cam) {
     cam.vup = vec3(0, 1, 0);
     cam.defocus_angle = 0;
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(scene_make<bvh_node>(world));
     cam.render(world);
 }
 
 void quads(hittable_list &world, camera &cam) {
-    auto red = make_shared<lamber>(color(1.0, 0.2, 0.2));
-    auto grn = make_shared<lamber>(color(0.2, 1.0, 0.2));
-    auto blu = make_shared<lamber>(color(0.2, 0.2, 1.0));
-    auto org = make_shared<lamber>(color(1.0, 0.5, 0.0));
-    auto tel = make_shared<lamber>(color(0.2, 0.8, 0.8));
-
-    world.add(make_shared<quad>(vec3(-3, -2, 5), vec3(0, 0, -4), vec3(0, 4, 0), red));
-    world.add(make_shared<quad>(vec3(-2, -2, 0), vec3(4, 0, 0), vec3(0, 4, 0), grn));
-    world.add(make_shared<quad>(vec3(3, -2, 1), vec3(0, 0, 4), vec3(0, 4, 0), blu));
-    world.add(make_shared<quad>(vec3(-2, 3, 1), vec3(4, 0, 0), vec3(0, 0, 4), org));
-    world.add(make_shared<quad>(vec3(-2, -3, 5), vec3(4, 0, 0), vec3(0, 0, -4), tel));
+    auto red = make_material<lamber>(color(1.0, 0.2, 0.2));
+    auto grn = make_material<lamber>(color(0.2, 1.0, 0.2));
+    auto blu = make_material<lamber>(color(0.2, 0.2, 1.0));
+    auto org = make_material<lamber>(color(1.0, 0.5, 0.0));
+    auto tel = make_material<lamber>(color(0.2, 0.8, 0.8));
+
+    world.add(scene_make<quad>(vec3(-3, -2, 5), vec3(0, 0, -4), vec3(0, 4, 0), red));
+    world.add(scene_make<quad>(vec3(-2, -2, 0), vec3(4, 0, 0), vec3(0, 4, 0), grn));
+    world.add(scene_make<quad>(vec3(3, -2, 1), vec3(0, 0, 4), vec3(0, 4, 0), blu));
+    world.add(scene_make<quad>(vec3(-2, 3, 1), vec3(4, 0, 0), vec3(0, 0, 4), org));
+    world.add(scene_make<quad>(vec3(-2, -3, 5), vec3(4, 0, 0), vec3(0, 0, -4), tel));
 
     cam.aspect = 1.0;
     cam.img_wd = 400;;
@@ -203,18 +204,22 @@ void quads(hittable_list &world, camera &cam) {
 
     cam.defocus_angle = 0;
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(scene_make<bvh_node>(world));
     cam.render(world);
 }
 
 void light(hittable_list &world, camera &cam) {
-    auto pertext = make_shared<noise_tex>(4);
-    world.add(make_shared<sphere>(vec3(0, -1000, 0), 1000, make_shared<lamber>(pertext)));
-    world.add(make_shared<sphere>(vec3(0, 2, 0), 2, make_shared<lamber>(pertext)));
+    auto pertext = scene_make<noise_tex>(4);
+    world.add(scene_make<sphere>(vec3(0, -1000, 0), 1000, make_material<lamber>(pertext)));
+    world.add(scene_make<sphere>(vec3(0, 2, 0), 2, make_material<lamber>(pertext)));
 
-    auto diff_light = make_shared<diffuse_light>(color(4, 4, 4));
-    world.add(make_shared<sphere>(vec3(0, 7, 0), 2, diff_light));
-    world.add(make_shared<quad>(vec3(3, 1, -2), vec3(2, 0, 0), vec3(0, 2, 0), diff_light));
+    auto diff_light = make_material<diffuse_light>(color(4, 4, 4));
+    world.add(scene_make<sphere>(vec3(0, 7, 0), 2, diff_light));
+    world.add(scene_make<quad>(vec3(3, 1, -2), vec3(2, 0, 0), vec3(0, 2, 0), diff_light));
+
+    hittable_list lights;
+    lights.add(scene_make<sphere>(vec3(0, 7, 0), 2, diff_light));
+    lights.add(scene_make<quad>(vec3(3, 1, -2), vec3(2, 0, 0), vec3(0, 2, 0), diff_light));
 
     cam.fov = 20;
     cam.lk_from = vec3(26, 3, 6);
@@ -228,36 +233,36 @@ void light(hittable_list &world, camera &cam) {
 
     cam.bg = color(0, 0, 0);
 
-    world = hittable_list(make_shared<bvh_node>(world));
-    cam.render(world);
+    world = hittable_list(scene_make<bvh_node>(world));
+    cam.render(world, lights);
 }
 
 void cornell_box(hittable_list &world, camera &cam) {
 
-    auto red   = make_shared<lamber>(color(.65, .05, .05));
-    auto wht = make_shared<lamber>(color(.73, .73, .73));
-    auto grn = make_shared<lamber>(color(.12, .45, .15));
-    auto lht = make_shared<diffuse_light>(color(15, 15, 15));
+    auto red   = make_material<lamber>(color(.65, .05, .05));
+    auto wht = make_material<lamber>(color(.73, .73, .73));
+    auto grn = make_material<lamber>(color(.12, .45, .15));
+    auto lht = make_material<diffuse_light>(color(15, 15, 15));
 
-    world.add(make_shared<quad>(vec3(555,0,0), vec3(0,555,0), vec3(0,0,555), grn));
-    world.add(make_shared<quad>(vec3(0,0,0), vec3(0,555,0), vec3(0,0,555), red));
-    world.add(make_shared<quad>(vec3(343, 554, 332), vec3(-130,0,0), vec3(0,0,-105), lht));
-    world.add(make_shared<quad>(vec3(0,0,0), vec3(555,0,0), vec3(0,0,555), wht));
-    world.add(make_shared<quad>(vec3(555,555,555), vec3(-555,0,0), vec3(0,0,-555), wht));
-    world.add(make_shared<quad>(vec3(0,0,555), vec3(555,0,0), vec3(0,555,0), wht));
+    world.add(scene_make<quad>(vec3(555,0,0), vec3(0,555,0), vec3(0,0,555), grn));
+    world.add(scene_make<quad>(vec3(0,0,0), vec3(0,555,0), vec3(0,0,555), red));
+    world.add(scene_make<quad>(vec3(343, 554, 332), vec3(-130,0,0), vec3(0,0,-105), lht));
+    world.add(scene_make<quad>(vec3(0,0,0), vec3(555,0,0), vec3(0,0,555), wht));
+    world.add(scene_make<quad>(vec3(555,555,555), vec3(-555,0,0), vec3(0,0,-555), wht));
+    world.add(scene_make<quad>(vec3(0,0,555), vec3(555,0,0), vec3(0,555,0), wht));
 
-    shared_ptr<material> alum = make_shared<metal>(color(0.8, 0.85, 0.88), 0.0);
+    material_id alum = make_material<metal>(color(0.8, 0.85, 0.88), 0.0);
     shared_ptr<hittable> b1 = box(vec3(0, 0, 0), vec3(165, 330, 165), alum);
-    b1 = make_shared<rotate_y>(b1, 15);
-    b1 = make_shared<translate>(b1, vec3(265, 0, 295));
+    b1 = scene_make<rotate_y>(b1, 15);
+    b1 = scene_make<translate>(b1, vec3(265, 0, 295));
     world.add(b1);
 
     shared_ptr<hittable> b2 = box(vec3(0, 0, 0), vec3(165, 165, 165), wht);
-    b2 = make_shared<rotate_y>(b2, -18);
-    b2 = make_shared<translate>(b2, vec3(130, 0, 65));
+    b2 = scene_make<rotate_y>(b2, -18);
+    b2 = scene_make<translate>(b2, vec3(130, 0, 65));
     world.add(b2);
 
-    auto emt = shared_ptr<material>();
+    auto emt = make_material<no_material>();
     quad lights(vec3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), emt);
 
     cam.aspect = 1.0;
@@ -273,35 +278,35 @@ void cornell_box(hittable_list &world, camera &cam) {
 
     cam.defocus_angle = 0;
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(scene_make<bvh_node>(world));
     cam.render(world, lights);
 }
 
 void cornell_smoke(hittable_list &world, camera &cam) {
-    auto red = make_shared<lamber>(color(0.65, 0.05, 0.05));
-    auto wht = make_shared<lamber>(color(0.73, 0.73, 0.73));
-    auto grn = make_shared<lamber>(color(0.12, 0.45, 0.15));
-    auto lgt = make_shared<diffuse_light>(color(15, 15, 15));
-
-    world.add(make_shared<quad>(vec3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), grn));
-    world.add(make_shared<quad>(vec3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
-    world.add(make_shared<quad>(vec3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), lgt));
-    world.add(make_shared<quad>(vec3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), wht));
-    world.add(make_shared<quad>(vec3(555, 555, 555), vec3(-555, 0, 0), vec3(0, 0, -555), wht));
-    world.add(make_shared<quad>(vec3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), wht));
+    auto red = make_material<lamber>(color(0.65, 0.05, 0.05));
+    auto wht = make_material<lamber>(color(0.73, 0.73, 0.73));
+    auto grn = make_material<lamber>(color(0.12, 0.45, 0.15));
+    auto lgt = make_material<diffuse_light>(color(15, 15, 15));
+
+    world.add(scene_make<quad>(vec3(555, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), grn));
+    world.add(scene_make<quad>(vec3(0, 0, 0), vec3(0, 555, 0), vec3(0, 0, 555), red));
+    world.add(scene_make<quad>(vec3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), lgt));
+    world.add(scene_make<quad>(vec3(0, 0, 0), vec3(555, 0, 0), vec3(0, 0, 555), wht));
+    world.add(scene_make<quad>(vec3(555, 555, 555), vec3(-555, 0, 0), vec3(0, 0, -555), wht));
+    world.add(scene_make<quad>(vec3(0, 0, 555), vec3(555, 0, 0), vec3(0, 555, 0), wht));
 
     // two small boxes
     shared_ptr<hittable> b1 = box(vec3(0, 0, 0), vec3(165, 330, 165), wht);
-    b1 = make_shared<rotate_y>(b1, 15);
-    b1 = make_shared<translate>(b1, vec3(265, 0, 295));
-    world.add(make_shared<medium>(b1, 0.01, color(0, 0, 0)));
+    b1 = scene_make<rotate_y>(b1, 15);
+    b1 = scene_make<translate>(b1, vec3(265, 0, 295));
+    world.add(scene_make<medium>(b1, 0.01, color(0, 0, 0)));
 
     shared_ptr<hittable> b2 = box(vec3(0, 0, 0), vec3(165, 165, 165), wht);
-    b2 = make_shared<rotate_y>(b2, -18);
-    b2 = make_shared<translate>(b2, vec3(140, 0, 65));
-    world.add(make_shared<medium>(b2, 0.01, color(1, 1, 1)));
+    b2 = scene_make<rotate_y>(b2, -18);
+    b2 = scene_make<translate>(b2, vec3(140, 0, 65));
+    world.add(scene_make<medium>(b2, 0.01, color(1, 1, 1)));
 
-    auto emt = shared_ptr<material>();
+    auto emt = make_material<no_material>();
     quad lights(vec3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), emt);
 
     cam.aspect = 1.0;
@@ -317,35 +322,35 @@ void cornell_smoke(hittable_list &world, camera &cam) {
 
     cam.defocus_angle = 0;
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(scene_make<bvh_node>(world));
     cam.render(world, lights);
 }
 
 void cornell_sphere(hittable_list &world, camera &cam) {
 
-    auto red   = make_shared<lamber>(color(.65, .05, .05));
-    auto wht = make_shared<lamber>(color(.73, .73, .73));
-    auto grn = make_shared<lamber>(color(.12, .45, .15));
-    auto lht = make_shared<diffuse_light>(color(15, 15, 15));
+    auto red   = make_material<lamber>(color(.65, .05, .05));
+    auto wht = make_material<lamber>(color(.73, .73, .73));
+    auto grn = make_material<lamber>(color(.12, .45, .15));
+    auto lht = make_material<diffuse_light>(color(15, 15, 15));
 
-    world.add(make_shared<quad>(vec3(555,0,0), vec3(0,555,0), vec3(0,0,555), grn));
-    world.add(make_shared<quad>(vec3(0,0,0), vec3(0,555,0), vec3(0,0,555), red));
-    world.add(make_shared<quad>(vec3(343, 554, 332), vec3(-130,0,0), vec3(0,0,-105), lht));
-    world.add(make_shared<quad>(vec3(0,0,0), vec3(555,0,0), vec3(0,0,555), wht));
-    world.add(make_shared<quad>(vec3(555,555,555), vec3(-555,0,0), vec3(0,0,-555), wht));
-    world.add(make_shared<quad>(vec3(0,0,555), vec3(555,0,0), vec3(0,555,0), wht));
+    world.add(scene_make<quad>(vec3(555,0,0), vec3(0,555,0), vec3(0,0,555), grn));
+    world.add(scene_make<quad>(vec3(0,0,0), vec3(0,555,0), vec3(0,0,555), red));
+    world.add(scene_make<quad>(vec3(343, 554, 332), vec3(-130,0,0), vec3(0,0,-105), lht));
+    world.add(scene_make<quad>(vec3(0,0,0), vec3(555,0,0), vec3(0,0,555), wht));
+    world.add(scene_make<quad>(vec3(555,555,555), vec3(-555,0,0), vec3(0,0,-555), wht));
+    world.add(scene_make<quad>(vec3(0,0,555), vec3(555,0,0), vec3(0,555,0), wht));
 
-    shared_ptr<material> alum = make_shared<metal>(color(0.8, 0.85, 0.88), 0.0);
+    material_id alum = make_material<metal>(color(0.8, 0.85, 0.88), 0.0);
     shared_ptr<hittable> b1 = box(vec3(0, 0, 0), vec3(165, 330, 165), alum);
-    b1 = make_shared<rotate_y>(b1, 15);
-    b1 = make_shared<translate>(b1, vec3(265, 0, 295));
+    b1 = scene_make<rotate_y>(b1, 15);
+    b1 = scene_make<translate>(b1, vec3(265, 0, 295));
     world.add(b1);
 
     // glass sphere
-    auto glass = make_shared<dielectric>(1.5);
-    world.add(make_shared<sphere>(vec3(190, 90, 190), 90, glass));
+    auto glass = make_material<dielectric>(1.5);
+    world.add(scene_make<sphere>(vec3(190, 90, 190), 90, glass));
 
-    auto emt = shared_ptr<material>();
+    auto emt = make_material<no_material>();
     quad lights(vec3(343, 554, 332), vec3(-130, 0, 0), vec3(0, 0, -105), emt);
 
     cam.aspect = 1.0;
@@ -361,15 +366,15 @@ void cornell_sphere(hittable_list &world, camera &cam) {
 
     cam.defocus_angle = 0;
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(scene_make<bvh_node>(world));
     cam.render(world, lights); 
 }
 
 void earth(hittable_list &world, camera &cam) {
 
-    auto earth_tex = make_shared<image_tex>("earthmap.jpg");
-    auto earth_sur = make_shared<lamber>(earth_tex);
-    auto globe = make_shared<sphere>(vec3(0, 0, 0), 2, earth_sur);
+    auto earth_tex = scene_make<image_tex>("earthmap.jpg");
+    auto earth_sur = make_material<lamber>(earth_tex);
+    auto globe = scene_make<sphere>(vec3(0, 0, 0), 2, earth_sur);
 
     world.add(globe);
 
@@ -382,14 +387,14 @@ void earth(hittable_list &world, camera &cam) {
     cam.lk_at = vec3(0, 0, 0);
     cam.defocus_angle = 0;
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(scene_make<bvh_node>(world));
     cam.render(world);
 }
 
 void book1_final(hittable_list &world, camera &cam) {
 
-    auto gnd = make_shared<lamber>(color(0.5, 0.5, 0.5));
-    world.add(make_shared<sphere>(vec3(0, -1000, 0), 1000, gnd));
+    auto gnd = make_material<lamber>(color(0.5, 0.5, 0.5));
+    world.add(scene_make<sphere>(vec3(0, -1000, 0), 1000, gnd));
 
     for (int i = -11; i < 11; i++) {
         for (int j = -11; j < 11; j++) {
@@ -397,31 +402,31 @@ void book1_final(hittable_list &world, camera &cam) {
             vec3 center(i + 0.9 * random_double(), 0.2, j + 0.9*random_double());
 
             if ((center - vec3(4, 0.2, 0)).len() > 0.9) {
-                shared_ptr<material> smat;
+                material_id smat;
 
                 if (choose_mat < 0.8) {             // diffuse
                     auto albedo = color::random() * color::random();
-                    smat = make_shared<lamber>(albedo);
+                    smat = make_material<lamber>(albedo);
                 } else if (choose_mat < 0.95) {     // metal
                     auto albedo = color::random(0.5, 1);
                     auto fuzz = random_double(0, 0.5);
-                    smat = make_shared<metal>(albedo, fuzz);
+                    smat = make_material<metal>(albedo, fuzz);
                 } else {                            // glass
-                    smat = make_shared<dielectric>(1.5);
+                    smat = make_material<dielectric>(1.5);
                 }
 
-                world.add(make_shared<sphere>(center, 0.2, smat));
+                world.add(scene_make<sphere>(center, 0.2, smat));
             }
         }
     }
 
-    auto m1 = make_shared<dielectric>(1.5);
-    auto m2 = make_shared<lamber>(color(0.4, 0.2, 0.1));
-    auto m3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
+    auto m1 = make_material<dielectric>(1.5);
+    auto m2 = make_material<lamber>(color(0.4, 0.2, 0.1));
+    auto m3 = make_material<metal>(color(0.7, 0.6, 0.5), 0.0);
 
-    world.add(make_shared<sphere>(vec3(0, 1, 0), 1.0, m1));
-    world.add(make_shared<sphere>(vec3(-4, 1, 0), 1.0, m2));
-    world.add(make_shared<sphere>(vec3(4, 1, 0), 1.0, m3));
+    world.add(scene_make<sphere>(vec3(0, 1, 0), 1.0, m1));
+    world.add(scene_make<sphere>(vec3(-4, 1, 0), 1.0, m2));
+    world.add(scene_make<sphere>(vec3(4, 1, 0), 1.0, m3));
 
 
     cam.aspect = 16.0 / 9.0;
@@ -439,16 +444,16 @@ void book1_final(hittable_list &world, camera &cam) {
     cam.focus_dist = 10.0;
 
     cam.is_hdr = true;
-    cam.bg_tex = make_shared<image_hdr_tex>("./hdr_assets/cinema.hdr");
+    cam.bg_tex = scene_make<image_hdr_tex>("./hdr_assets/cinema.hdr");
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(scene_make<bvh_node>(world));
     cam.render(world);
 }
 
 void book2_final(hittable_list &world, camera &cam) {
     
     hittable_list boxes;
-    auto gnd = make_shared<lamber>(color(0.48, 0.83, 0.53));
+    auto gnd = make_material<lamber>(color(0.48, 0.83, 0.53));
 
     int box_cnt = 20;
     for (int i = 0; i < box_cnt; i++) {
@@ -465,40 +470,40 @@ void book2_final(hittable_list &world, camera &cam) {
         }
     }
 
-    world.add(make_shared<bvh_node>(boxes));
+    world.add(scene_make<bvh_node>(boxes));
 
-    auto lght = make_shared<diffuse_light>(color(7, 7, 7));
-    auto emt = make_shared<material>();
-    world.add(make_shared<quad>(vec3(123, 554, 147), vec3(300, 0, 0), vec3(0, 0, 265), lght));
+    auto lght = make_material<diffuse_light>(color(7, 7, 7));
+    auto emt = make_material<no_material>();
+    world.add(scene_make<quad>(vec3(123, 554, 147), vec3(300, 0, 0), vec3(0, 0, 265), lght));
     quad lights(vec3(123, 554, 147), vec3(300, 0, 0), vec3(0, 0, 265), emt);
 
     auto c1 = vec3(400, 400, 200);
     auto c2 = c1 + vec3(30, 0, 0);
-    auto sphere_mat = make_shared<lamber>(color(0.7, 0.3, 0.1));
-    world.add(make_shared<sphere>(c1, c2, 50, sphere_mat));
+    auto sphere_mat = make_material<lamber>(color(0.7, 0.3, 0.1));
+    world.add(scene_make<sphere>(c1, c2, 50, sphere_mat));
 
-    world.add(make_shared<sphere>(vec3(260, 150, 45), 50, make_shared<dielectric>(1.5)));
-    world.add(make_shared<sphere>(vec3(0, 150, 145), 50, make_shared<metal>(color(0.8, 0.8, 0.9), 1.0)));
+    world.add(scene_make<sphere>(vec3(260, 150, 45), 50, make_material<dielectric>(1.5)));
+    world.add(scene_make<sphere>(vec3(0, 150, 145), 50, make_material<metal>(color(0.8, 0.8, 0.9), 1.0)));
 
-    auto boundary = make_shared<sphere>(vec3(360, 150, 145), 70, make_shared<dielectric>(1.5));
+    auto boundary = scene_make<sphere>(vec3(360, 150, 145), 70, make_material<dielectric>(1.5));
     world.add(boundary);
-    world.add(make_shared<medium>(boundary, 0.2, color(0.2, 0.4, 0.9)));
-    boundary = make_shared<sphere>(vec3(0, 0, 0), 5000, make_shared<dielectric>(1.5));
-    world.add(make_shared<medium>(boundary, 0.0001, color(1, 1, 1)));
+    world.add(scene_make<medium>(boundary, 0.2, color(0.2, 0.4, 0.9)));
+    boundary = scene_make<sphere>(vec3(0, 0, 0), 5000, make_material<dielectric>(1.5));
+    world.add(scene_make<medium>(boundary, 0.0001, color(1, 1, 1)));
 
-    auto emat = make_shared<lamber>(make_shared<image_tex>("earthmap.jpg"));
-    world.add(make_shared<sphere>(vec3(400, 200, 400), 100, emat));
-    auto pertext = make_shared<noise_tex>(0.2);
-    world.add(make_shared<sphere>(vec3(220, 280, 300), 80, make_shared<lamber>(pertext)));
+    auto emat = make_material<lamber>(scene_make<image_tex>("earthmap.jpg"));
+    world.add(scene_make<sphere>(vec3(400, 200, 400), 100, emat));
+    auto pertext = scene_make<noise_tex>(0.2);
+    world.add(scene_make<sphere>(vec3(220, 280, 300), 80, make_material<lamber>(pertext)));
 
     hittable_list boxes2;
-    auto wht = make_shared<lamber>(color(0.73, 0.73, 0.73));
+    auto wht = make_material<lamber>(color(0.73, 0.73, 0.73));
     int ns = 1000;
     for (int j = 0; j < ns; j++) {
-        boxes2.add(make_shared<sphere>(vec3::random(0, 165), 10, wht));
+        boxes2.add(scene_make<sphere>(vec3::random(0, 165), 10, wht));
     }
 
-    world.add(make_shared<translate>(make_shared<rotate_y>(make_shared<bvh_node>(boxes2), 15), vec3(-100, 270, 395)));
+    world.add(scene_make<translate>(scene_make<rotate_y>(scene_make<bvh_node>(boxes2), 15), vec3(-100, 270, 395)));
 
     cam.aspect = 1.0;
     cam.img_wd = 1000;
@@ -512,16 +517,16 @@ void book2_final(hittable_list &world, camera &cam) {
     cam.vup = vec3(0, 1, 0);
     cam.defocus_angle = 0;
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(scene_make<bvh_node>(world));
     // cam.render(world);
     cam.render(world, lights);
 }
 
 void triangle_scene(hittable_list &world, camera &cam) {
 
-    auto red = make_shared<lamber>(color(1.0, 0.0, 0.0));
+    auto red = make_material<lamber>(color(1.0, 0.0, 0.0));
 
-    world.add(make_shared<triangle>(
+    world.add(scene_make<triangle>(
         vec3(0, 1, 0),
         vec3(-1, 0, 0),
         vec3(1, 0, 0),
@@ -531,7 +536,7 @@ void triangle_scene(hittable_list &world, camera &cam) {
     cam.lk_from = vec3(0, 5, -5);
     cam.lk_at = vec3(0, 0, 0);
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(scene_make<bvh_node>(world));
     cam.render(world);
 }
 
@@ -539,8 +544,8 @@ void teapot(hittable_list &world, camera &cam) {
 
     // can be any material type. Could take in a list of files
     // and a list of materials
-    auto mat = std::make_shared<lamber>(color(0.9, 0.0, 0.0));
-    auto glass = std::make_shared<dielectric>(1.50);
+    auto mat = make_material<lamber>(color(0.9, 0.0, 0.0));
+    [[maybe_unused]] auto glass = make_material<dielectric>(1.50);
 
     obj_loader loader;
 
@@ -556,40 +561,40 @@ void teapot(hittable_list &world, camera &cam) {
     }
 
     // Wall lights
-    auto diff_light = make_shared<diffuse_light>(color(4, 4, 4));
-    auto emt = make_shared<material>();
+    auto diff_light = make_material<diffuse_light>(color(4, 4, 4));
+    auto emt = make_material<no_material>();
     // world.add(make_shared<quad>(vec3(-2, 1, -7.75), vec3(5, 0, 0), vec3(0, 2, 0), diff_light)); 
     // quad lights(vec3(-2, 1, -7.75), vec3(5, 0, 0), vec3(0, 2, 0), emt);
 
     // world.add(make_shared<sphere>(vec3(0, 1, 0), 0.75, diff_light));
 
-    // auto mirror = make_shared<metal>(color(0.5, 0.5, 0.5), 0.0);
-    // auto glass = make_shared<dielectric>(1.5);
-    // auto g1 = make_shared<dielectric>(1.0);
+    // auto mirror = make_material<metal>(color(0.5, 0.5, 0.5), 0.0);
+    // auto glass = make_material<dielectric>(1.5);
+    // auto g1 = make_material<dielectric>(1.0);
     // world.add(make_shared<sphere>(vec3(-7, 1, 2), 3, glass)); 
     // world.add(make_shared<sphere>(vec3(-7, 1, 2), 2.5, g1));
 
     // The containing box
     // Floor:
-    auto gnd = make_shared<metal>(color(0.3, 0.3, 0.3), 0.5);   
-    // auto gnd = make_shared<lamber>(color(0.0, 0.0, 0.0)); 
-    world.add(make_shared<quad>(vec3(-4, 0, -4), vec3(8, 0, 0), vec3(0, 0, 8), gnd));
+    auto gnd = make_material<metal>(color(0.3, 0.3, 0.3), 0.5);   
+    // auto gnd = make_material<lamber>(color(0.0, 0.0, 0.0)); 
+    world.add(scene_make<quad>(vec3(-4, 0, -4), vec3(8, 0, 0), vec3(0, 0, 8), gnd));
     // Ceiling:
-    auto ceil = make_shared<metal>(color(1.0, 0.3, 0.3), 0.9);
-    world.add(make_shared<quad>(vec3(-4, 8, -4), vec3(4, 0, 0), vec3(0, 0, 8), ceil));
+    auto ceil = make_material<metal>(color(1.0, 0.3, 0.3), 0.9);
+    world.add(scene_make<quad>(vec3(-4, 8, -4), vec3(4, 0, 0), vec3(0, 0, 8), ceil));
     // ceiling light;
-    world.add(make_shared<quad>(vec3(-1, 7.75, -1), vec3(2, 0, 0), vec3(0, 0, 2), diff_light));
+    world.add(scene_make<quad>(vec3(-1, 7.75, -1), vec3(2, 0, 0), vec3(0, 0, 2), diff_light));
     quad lights(vec3(-1, 7.75, -1), vec3(2, 0, 0), vec3(0, 0, 2), emt);
 
     // Back wall
-    auto walls = make_shared<lamber>(color(0.1, 0.05, 0.1));
-    world.add(make_shared<quad>(vec3(-4, 0, -4), vec3(8, 0, 0), vec3(0, 8, 0), walls));
+    auto walls = make_material<lamber>(color(0.1, 0.05, 0.1));
+    world.add(scene_make<quad>(vec3(-4, 0, -4), vec3(8, 0, 0), vec3(0, 8, 0), walls));
     // front wall
-    world.add(make_shared<quad>(vec3(-4, 0, 4), vec3(8, 0, 0), vec3(0, 8, 0), walls));
+    world.add(scene_make<quad>(vec3(-4, 0, 4), vec3(8, 0, 0), vec3(0, 8, 0), walls));
     // left wall
-    world.add(make_shared<quad>(vec3(-4, 0, -4), vec3(0, 8, 0), vec3(0, 0, 8), walls));
+    world.add(scene_make<quad>(vec3(-4, 0, -4), vec3(0, 8, 0), vec3(0, 0, 8), walls));
     // right wall
-    world.add(make_shared<quad>(vec3(4, 0, -4), vec3(0, 8, 0), vec3(0, 0, 8), walls));
+    world.add(scene_make<quad>(vec3(4, 0, -4), vec3(0, 8, 0), vec3(0, 0, 8), walls));
 
     cam.img_wd = 600;
     cam.anti_alias = 500;
@@ -603,17 +608,16 @@ void teapot(hittable_list &world, camera &cam) {
 
     cam.bg = color(0.0, 0.0, 0.0);
 
-    world = hittable_list(make_shared<bvh_node>(world));
-    // cam.render(world, lights);
-    cam.render(world);
+    world = hittable_list(scene_make<bvh_node>(world));
+    cam.render(world, lights);
 }
 
 void hdri(hittable_list &world, camera &cam) {
 
-    auto alum = make_shared<metal>(color(0.8, 0.85, 0.88), 0.0);
-    auto hdri_tex = make_shared<image_hdr_tex>("./hdr_assets/esplanade.hdr");
-    auto blue = make_shared<lamber>(color(0.1, 0.2, 0.8));
-    // auto hdri = make_shared<lamber>(hdri_tex);
+    [[maybe_unused]] auto alum = make_material<metal>(color(0.8, 0.85, 0.88), 0.0);
+    auto hdri_tex = scene_make<image_hdr_tex>("./hdr_assets/esplanade.hdr");
+    auto blue = make_material<lamber>(color(0.1, 0.2, 0.8));
+    // auto hdri = make_material<lamber>(hdri_tex);
     // world.add(make_shared<sphere>(vec3(0, 1, 0), 2, alum));
 
     obj_loader loader;
@@ -638,14 +642,14 @@ void hdri(hittable_list &world, camera &cam) {
     cam.lk_at = vec3(0, 1, 0);
 
     cam.bg_tex = hdri_tex;
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(scene_make<bvh_node>(world));
     cam.render(world);
 }
 
 void testing(hittable_list &world, camera &cam) {
 
     obj_loader loader;
-    auto grn = make_shared<lamber>(color(0.1, 0.7, 0.1));
+    [[maybe_unused]] auto grn = make_material<lamber>(color(0.1, 0.7, 0.1));
 
     // if (loader.load_meshes("./objects/testing_obj.obj", "./objects/testing_obj.mtl")) {
     if (loader.load_meshes("./objects/cylinder.obj", "./objects/cylinder.mtl")) {
@@ -666,8 +670,8 @@ void testing(hittable_list &world, camera &cam) {
         world.add(tri);
     }
 
-    auto gnd = make_shared<lamber>(color(0.1, 0.1, 1.0));
-    world.add(make_shared<quad>(vec3(-16, 0, -16), vec3(32, 0, 0), vec3(0, 0, 32), gnd));
+    auto gnd = make_material<lamber>(color(0.1, 0.1, 1.0));
+    world.add(scene_make<quad>(vec3(-16, 0, -16), vec3(32, 0, 0), vec3(0, 0, 32), gnd));
 
     cam.lk_from = vec3(12, 4, 0);
     cam.lk_at = vec3(0, 1.5, 0);
@@ -678,8 +682,16 @@ void testing(hittable_list &world, camera &cam) {
 
     // cam.bg = color(0.5, 0.1, 0.1);
     
-    world = hittable_list(make_shared<bvh_node>(world));
-    cam.render(world);
+    world = hittable_list(scene_make<bvh_node>(world));
+
+    // emissive faces in the mesh become sampled lights
+    light_bvh lights(loader.get_lights());
+    if (lights.size() > 0) {
+        std::clog << "\nsampling " << lights.size() << " emissive triangles\n" << std::flush;
+        cam.render(world, lights);
+    } else {
+        cam.render(world);
+    }
 }
 
 void submission(hittable_list &world, camera &cam) {
@@ -690,22 +702,22 @@ void submission(hittable_list &world, camera &cam) {
     auto whte_col = color(1.00, 1.00, 1.00);
 
     // Standard materials
-    auto alum = make_shared<metal>(color(0.8, 0.85, 0.88), 0.0);    // aluminum material
-    auto blue = make_shared<lamber>(blue_col);                      // blue color for teapot
-    auto whte = make_shared<lamber>(whte_col);                      // white color
-    auto red  = make_shared<lamber>(red_col);                       // red color
-    auto chck = make_shared<checkers>(0.5, blue_col, red_col);      // checkers texture
-    auto grnd = make_shared<lamber>(chck);                          // ground material
-    auto glss = make_shared<dielectric>(1.5);                       // dielectric for window
-    auto gair = make_shared<dielectric>(1.0);                       // dielectric for air
+    auto alum = make_material<metal>(color(0.8, 0.85, 0.88), 0.0);    // aluminum material
+    [[maybe_unused]] auto blue = make_material<lamber>(blue_col);                      // blue color for teapot
+    [[maybe_unused]] auto whte = make_material<lamber>(whte_col);                      // white color
+    auto red  = make_material<lamber>(red_col);                       // red color
+    auto chck = scene_make<checkers>(0.5, blue_col, red_col);      // checkers texture
+    auto grnd = make_material<lamber>(chck);                          // ground material
+    auto glss = make_material<dielectric>(1.5);                       // dielectric for window
+    auto gair = make_material<dielectric>(1.0);                       // dielectric for air
     
     // hdri background
-    auto hdri_tex = make_shared<image_hdr_tex>("./hdr_assets/cinema.hdr");
+    auto hdri_tex = scene_make<image_hdr_tex>("./hdr_assets/cinema.hdr");
     cam.bg_tex = hdri_tex;
     cam.bg = color(0.7, 0.8, 1.0);
 
     // ground placement
-    world.add(make_shared<quad>(vec3(-6, 0, -6), vec3(12, 0, 0), vec3(0, 0, 12), grnd));
+    world.add(scene_make<quad>(vec3(-6, 0, -6), vec3(12, 0, 0), vec3(0, 0, 12), grnd));
 
     // scene objects
     obj_loader obj;
@@ -717,12 +729,12 @@ void submission(hittable_list &world, camera &cam) {
     }
 
     // shared_ptr<hittable> b = box(vec3(0, 0, 0), vec3(2, 2.5, 2), alum);
-    // b = make_shared<translate>(b, vec3(3.75, 0, -1));
+    // b = scene_make<translate>(b, vec3(3.75, 0, -1));
     // world.add(b);
-    world.add(make_shared<sphere>(vec3(4.5, 1.5, -2), 1.5, alum));
+    world.add(scene_make<sphere>(vec3(4.5, 1.5, -2), 1.5, alum));
 
-    world.add(make_shared<sphere>(vec3(-3, 1.5, 3), 1.5, glss));
-    world.add(make_shared<sphere>(vec3(-3, 1.5, 3), 1.1, gair));
+    world.add(scene_make<sphere>(vec3(-3, 1.5, 3), 1.5, glss));
+    world.add(scene_make<sphere>(vec3(-3, 1.5, 3), 1.1, gair));
     
 
     // camera configuration
@@ -737,23 +749,23 @@ void submission(hittable_list &world, camera &cam) {
     cam.fov = 35;
     // cam.focus_dist = 0.6;
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(scene_make<bvh_node>(world));
     cam.render(world);
 }
 
 void materials(hittable_list &world, camera &cam) {
 
-    auto grnd = make_shared<lamber>(color(0.8, 0.8, 0.0));
-    auto cntr = make_shared<lamber>(color(0.1, 0.2, 0.5));
-    auto glss = make_shared<dielectric>(1.50);
-    auto gair = make_shared<dielectric>(1.00 / 1.50);
-    auto rght = make_shared<metal>(color(0.8, 0.6, 0.2), 0.2);
+    auto grnd = make_material<lamber>(color(0.8, 0.8, 0.0));
+    auto cntr = make_material<lamber>(color(0.1, 0.2, 0.5));
+    auto glss = make_material<dielectric>(1.50);
+    auto gair = make_material<dielectric>(1.00 / 1.50);
+    auto rght = make_material<metal>(color(0.8, 0.6, 0.2), 0.2);
 
-    world.add(make_shared<sphere>(vec3( 0.0, -100.5, -1.0), 100.0, grnd));
-    world.add(make_shared<sphere>(vec3( 0.0,    0.0, -1.2),   0.5, cntr));
-    world.add(make_shared<sphere>(vec3(-1.0,    0.0, -1.0),   0.5, glss));
-    world.add(make_shared<sphere>(vec3(-1.0,    0.0, -1.0),   0.4, gair));
-    world.add(make_shared<sphere>(vec3( 1.0,    0.0, -1.0),   0.5, rght));
+    world.add(scene_make<sphere>(vec3( 0.0, -100.5, -1.0), 100.0, grnd));
+    world.add(scene_make<sphere>(vec3( 0.0,    0.0, -1.2),   0.5, cntr));
+    world.add(scene_make<sphere>(vec3(-1.0,    0.0, -1.0),   0.5, glss));
+    world.add(scene_make<sphere>(vec3(-1.0,    0.0, -1.0),   0.4, gair));
+    world.add(scene_make<sphere>(vec3( 1.0,    0.0, -1.0),   0.5, rght));
 
     cam.aspect = 16.0 / 9.0;
     cam.img_wd = 400;
@@ -767,17 +779,17 @@ void materials(hittable_list &world, camera &cam) {
     cam.lk_from = vec3(0, 0.5, 2.5);
     cam.lk_at = vec3(0, 0.15, 0);
 
-    world = hittable_list(make_shared<bvh_node>(world));
+    world = hittable_list(scene_make<bvh_node>(world));
     cam.render(world);
 }
 
 void shapes(hittable_list &world, camera &cam) {
 
-    auto gold = make_shared<metal>(color(0.8, 0.6, 0.2), 0.0);
-    auto red   = make_shared<lamber>(color(.65, .05, .05));
-    auto wht = make_shared<lamber>(color(.73, .73, .73));
-    auto grn = make_shared<lamber>(color(.12, .45, .15));
-    auto lht = make_shared<diffuse_light>(color(15, 15, 15));
+    [[maybe_unused]] auto gold = make_material<metal>(color(0.8, 0.6, 0.2), 0.0);
+    [[maybe_unused]] auto red   = make_material<lamber>(color(.65, .05, .05));
+    [[maybe_unused]] auto wht = make_material<lamber>(color(.73, .73, .73));
+    [[maybe_unused]] auto grn = make_material<lamber>(color(.12, .45, .15));
+    [[maybe_unused]] auto lht = make_material<diffuse_light>(color(15, 15, 15));
 
     // cornell box
     // world.add(make_shared<)
@@ -820,10 +832,49 @@ int main(int argc, char *argv[]) {
                 select = std::stoi(arg.substr(7));
             } else if (arg.find("-alias=") == 0) {
                 cam.anti_alias = std::stoi(arg.substr(7)) > 0 ? std::stoi(arg.substr(7)) : default_anti_alias;
+            } else if (arg.find("-adaptive=") == 0) {
+                cam.adaptive = true;
+                cam.adaptive_threshold = std::stod(arg.substr(10)) > 0 ? std::stod(arg.substr(10)) : default_adaptive_threshold;
+            } else if (arg.find("-progressive=") == 0) {
+                cam.progressive = true;
+                cam.pass_spp = std::stoi(arg.substr(13)) > 0 ? std::stoi(arg.substr(13)) : cam.pass_spp;
+            } else if (arg.find("-time=") == 0) {
+                cam.progressive = true;
+                cam.time_budget = std::stod(arg.substr(6));
+            } else if (arg.find("-out=") == 0) {
+                cam.out_path = arg.substr(5);
+            } else if (arg.find("-format=") == 0) {
+                cam.out_format = format_from_name(arg.substr(8));
+            } else if (arg.find("-checkpoint=") == 0) {
+                cam.checkpoint_path = arg.substr(12);
+            } else if (arg.find("-checkpoint-every=") == 0) {
+                cam.checkpoint_interval = std::stod(arg.substr(18));
+            } else if (arg == "-resume") {
+                cam.resume = true;
+            } else if (arg == "-stream") {
+                cam.stream = true;
+            } else if (arg == "-wavefront") {
+                cam.wavefront = true;
+            } else if (arg.find("-packets=") == 0) {
+                cam.wavefront = true;
+                cam.packet_size = std::stoi(arg.substr(9));
+            } else if (arg.find("-serve=") == 0) {
+                cam.serve_addr = arg.substr(7);
+            } else if (arg.find("-connect=") == 0) {
+                cam.connect_addr = arg.substr(9);
+            } else if (arg.find("-sampler=") == 0) {
+                std::string name = arg.substr(9);
+                cam.sampler = name == "random" ? sampler_type::RANDOM
+                            : name == "halton" ? sampler_type::HALTON
+                            : sampler_type::SOBOL;
             }
         }
     }
 
+    // workers started with the same options build the same scene, random_double() on this
+    // thread starts from a fixed state in every process
+    cam.scene_id = select;
+
     std::clog << "option: " << select << "\n" << std::flush;
     std::clog << "\nStart time: " << std::put_time(std::localtime(&start_time_t), "%H:%M:%S\n") << std::flush;
 